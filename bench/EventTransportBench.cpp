@@ -0,0 +1,111 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Backlog.hpp"
+#include "HarpoonEventQueue.hpp"
+
+// Pushes chat messages from a producer thread through EventQueue into a
+// Backlog with a byte budget the same way hackchat::Client and NCurses do
+// and counts heap allocations once the pool and the backlog are warmed up.
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+bool RUNNING = true;
+
+static const char* const texts[] = {
+    "hi",
+    "anyone around?",
+    "the quick brown fox jumps over the lazy dog, again and again and again",
+    "```\nint main()\n{\n    return 0;\n}\n```",
+    "ok",
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.",
+};
+static const size_t textCount = sizeof(texts) / sizeof(texts[0]);
+static const size_t longestText = 128;
+
+static void produce(EventQueue& queue, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        EventMessage event = queue.messages.acquire();
+        event.time = EventMessage::currentTime();
+        event.flags = EventMessage::Flags();
+        event.sender = InternedString("bench");
+        event.message.assign(texts[i % textCount]);
+        queue.push(std::move(event));
+    }
+}
+
+static size_t received = 0;
+
+static void consume(EventQueue& queue, Backlog& backlog, std::vector<Event>& batch, size_t until)
+{
+    while (received < until)
+    {
+        queue.drain(batch);
+        for (auto& event : batch)
+            queue.messages.release(backlog.push(std::move(std::get<EventMessage>(event))));
+        received += batch.size();
+        batch.clear();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const size_t budget = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1 << 20;
+    EventQueue queue;
+    Backlog backlog(0, budget, nullptr, {});
+    backlog.setWidth(80);
+    std::vector<Event> batch;
+    batch.reserve(4096);
+
+    // as many payloads as the queue and a drained batch hold, grown to the
+    // longest text like after a long session, the pool never runs dry
+    for (size_t i = 0; i < 2 * 4096 + 1; ++i)
+    {
+        EventMessage message;
+        message.message.reserve(longestText);
+        queue.messages.release(std::move(message));
+    }
+
+    std::thread producer(produce, std::ref(queue), 2 * count);
+    consume(queue, backlog, batch, count); // warm-up
+
+    const size_t before = allocations.load();
+    const size_t warm = received;
+    const auto start = std::chrono::steady_clock::now();
+    consume(queue, backlog, batch, 2 * count);
+    const auto duration = std::chrono::steady_clock::now() - start;
+    const size_t allocated = allocations.load() - before;
+    const size_t measured = received - warm;
+    producer.join();
+
+    const double seconds = std::chrono::duration<double>(duration).count();
+    std::printf("messages:            %zu\n", measured);
+    std::printf("messages/s:          %.0f\n", measured / seconds);
+    std::printf("heap allocations:    %zu\n", allocated);
+    std::printf("allocations/message: %.6f\n", static_cast<double>(allocated) / measured);
+    std::printf("backlog:             %zu messages in %zu bytes\n", backlog.size(), backlog.bytes());
+    if (allocated > 0)
+    {
+        std::fprintf(stderr, "expected no heap allocations once warmed up\n");
+        return 1;
+    }
+    return 0;
+}
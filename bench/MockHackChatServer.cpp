@@ -0,0 +1,291 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/program_options.hpp>
+#include <json/json.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/server.hpp>
+
+// Stand-in for wss://hack.chat/chat-ws. Answers the commands the client
+// sends (join, chat, ping) and pushes a configurable traffic profile to
+// every joined connection. Point the client at it with
+//   harpoon2 --server wss://localhost:8443 --latency-report ...
+
+namespace po = boost::program_options;
+
+using Server = websocketpp::server<websocketpp::config::asio_tls>;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+/// self-signed certificate for localhost, generated at startup
+std::shared_ptr<boost::asio::ssl::context> makeTlsContext()
+{
+    auto ctx = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_server);
+    std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(EVP_EC_gen("P-256"), &EVP_PKEY_free);
+    std::unique_ptr<X509, decltype(&X509_free)> cert(X509_new(), &X509_free);
+    if (!key || !cert) throw std::runtime_error("Failed to create certificate");
+
+    X509_set_version(cert.get(), 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert.get()), 24 * 60 * 60);
+    X509_set_pubkey(cert.get(), key.get());
+    X509_NAME* name = X509_get_subject_name(cert.get());
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert.get(), name);
+    if (!X509_sign(cert.get(), key.get(), EVP_sha256())) throw std::runtime_error("Failed to sign certificate");
+
+    if (SSL_CTX_use_certificate(ctx->native_handle(), cert.get()) != 1
+        || SSL_CTX_use_PrivateKey(ctx->native_handle(), key.get()) != 1)
+        throw std::runtime_error("Failed to load certificate");
+    return ctx;
+}
+
+int64_t now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+std::string quoted(std::string_view text)
+{
+    Json::Value value(std::string(text.data(), text.size()));
+    return Json::writeString(Json::StreamWriterBuilder(), value);
+}
+
+std::string chatFrame(std::string_view nick, std::string_view text)
+{
+    return "{\"cmd\":\"chat\",\"nick\":" + quoted(nick)
+           + ",\"trip\":\"bench\",\"text\":" + quoted(text)
+           + ",\"time\":" + std::to_string(now()) + "}";
+}
+std::string userFrame(const char* cmd, std::string_view nick)
+{
+    return std::string("{\"cmd\":\"") + cmd + "\",\"nick\":" + quoted(nick)
+           + ",\"time\":" + std::to_string(now()) + "}";
+}
+std::string onlineSetFrame(size_t count)
+{
+    std::string frame = "{\"cmd\":\"onlineSet\",\"nicks\":[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i) frame += ',';
+        frame += "\"user" + std::to_string(i) + "\"";
+    }
+    frame += "],\"time\":" + std::to_string(now()) + "}";
+    return frame;
+}
+
+struct Options
+{
+    std::string profile;
+    size_t rate;
+    size_t nicks;
+    size_t size;
+    unsigned duration;
+};
+
+class MockServer
+{
+public:
+    MockServer(const Options& options, uint16_t port)
+        : options(options)
+        , timer(server.get_io_service())
+        , generated(0)
+        , sentFrames(0)
+        , sentBytes(0)
+    {
+        server.clear_access_channels(websocketpp::log::alevel::all);
+        server.init_asio();
+        server.set_reuse_addr(true);
+        auto tls = makeTlsContext();
+        server.set_tls_init_handler([tls](auto hdl){ return tls; });
+        server.set_message_handler([this](auto hdl, Server::message_ptr msg){ onMessage(hdl, msg->get_payload()); });
+        server.set_close_handler([this](auto hdl){ joined.erase(hdl); });
+        server.listen(port);
+        server.start_accept();
+    }
+
+    void run()
+    {
+        start = Clock::now();
+        schedule();
+        server.run();
+
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::printf("profile:     %s\n", options.profile.c_str());
+        std::printf("frames sent: %llu\n", static_cast<unsigned long long>(sentFrames));
+        std::printf("frames/s:    %.0f\n", sentFrames / seconds);
+        std::printf("MB/s:        %.2f\n", sentBytes / seconds / 1e6);
+    }
+
+private:
+    static constexpr std::chrono::milliseconds TickInterval{10};
+
+    void onMessage(websocketpp::connection_hdl hdl, const std::string& payload)
+    {
+        Json::Value root;
+        std::string errors;
+        std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+        if (!reader->parse(payload.data(), payload.data() + payload.size(), &root, &errors)) return;
+
+        const std::string cmd = root["cmd"].asString();
+        if (cmd == "join")
+        {
+            std::string nick = root["nick"].asString();
+            nick = nick.substr(0, nick.find('#'));
+            joined[hdl] = nick;
+            send(hdl, onlineSetFrame(options.profile == "onlineset" ? options.nicks : 50));
+            send(hdl, "{\"cmd\":\"info\",\"text\":\"welcome to the mock server, profile "
+                      + options.profile + "\",\"time\":" + std::to_string(now()) + "}");
+        }
+        else if (cmd == "chat")
+        {
+            auto it = joined.find(hdl);
+            if (it == joined.end()) return;
+            broadcast(chatFrame(it->second, root["text"].asString()));
+        }
+        // ping needs no answer
+    }
+
+    void schedule()
+    {
+        timer.expires_after(TickInterval);
+        timer.async_wait(
+            [this](const boost::system::error_code& ec)
+            {
+                if (ec) return;
+                if (Clock::now() - start >= std::chrono::seconds(options.duration))
+                {
+                    server.stop_listening();
+                    for (auto& entry : joined)
+                    {
+                        websocketpp::lib::error_code ignored;
+                        server.close(entry.first, websocketpp::close::status::going_away, "done", ignored);
+                    }
+                    return;
+                }
+                generate();
+                schedule();
+            });
+    }
+
+    /// one tick of the traffic profile
+    void generate()
+    {
+        const uint64_t target = static_cast<uint64_t>(
+            std::chrono::duration<double>(Clock::now() - start).count() * options.rate);
+        const std::string& profile = options.profile;
+        for (; generated < target; ++generated)
+        {
+            const std::string nick = "bot" + std::to_string(generated % 97);
+            if (profile == "joins")
+            {
+                const std::string joiner = "joiner" + std::to_string(generated / 2 % 1000);
+                broadcast(userFrame(generated % 2 ? "onlineRemove" : "onlineAdd", joiner));
+            }
+            else if (profile == "onlineset")
+            {
+                broadcast(onlineSetFrame(options.nicks));
+            }
+            else if (profile == "large")
+            {
+                std::string text;
+                text.reserve(options.size);
+                while (text.size() < options.size) text += "lorem ipsum dolor sit amet, consectetur adipiscing elit ";
+                text.resize(options.size);
+                broadcast(chatFrame(nick, text));
+            }
+            else if (profile == "mixed" && generated % 50 == 0)
+            {
+                broadcast("{\"cmd\":\"warn\",\"text\":\"mock warning\",\"time\":" + std::to_string(now()) + "}");
+            }
+            else if (profile == "mixed" && generated % 50 == 1)
+            {
+                broadcast("{\"cmd\":\"info\",\"type\":\"emote\",\"nick\":\"" + nick
+                          + "\",\"text\":\"@" + nick + " waves\",\"time\":" + std::to_string(now()) + "}");
+            }
+            else
+            {
+                broadcast(chatFrame(nick, "steady message number " + std::to_string(generated)));
+            }
+        }
+    }
+
+    void broadcast(const std::string& frame)
+    {
+        for (auto& entry : joined) send(entry.first, frame);
+    }
+    void send(websocketpp::connection_hdl hdl, const std::string& frame)
+    {
+        websocketpp::lib::error_code ec;
+        server.send(hdl, frame, websocketpp::frame::opcode::text, ec);
+        if (ec) return;
+        ++sentFrames;
+        sentBytes += frame.size();
+    }
+
+    const Options& options;
+    Server server;
+    boost::asio::steady_timer timer;
+    std::map<websocketpp::connection_hdl, std::string, std::owner_less<websocketpp::connection_hdl>> joined;
+    Clock::time_point start;
+    uint64_t generated;
+    uint64_t sentFrames;
+    uint64_t sentBytes;
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    uint16_t port;
+    po::options_description desc("Options");
+    try
+    {
+        po::variables_map vm;
+        desc.add_options()
+                ("help", "Show this help")
+                ("port", po::value<uint16_t>(&port)->default_value(8443), "Port to listen on")
+                ("profile", po::value<std::string>(&options.profile)->default_value("steady"),
+                 "steady, joins, onlineset, large or mixed")
+                ("rate", po::value<size_t>(&options.rate)->default_value(1000), "Frames per second per connection, keep it low for onlineset")
+                ("nicks", po::value<size_t>(&options.nicks)->default_value(10000), "Nicks per onlineSet (onlineset)")
+                ("size", po::value<size_t>(&options.size)->default_value(4096), "Message size in bytes (large)")
+                ("duration", po::value<unsigned>(&options.duration)->default_value(30), "Seconds of traffic");
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help"))
+        {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+        const std::string& profile = options.profile;
+        if (profile != "steady" && profile != "joins" && profile != "onlineset" && profile != "large" && profile != "mixed")
+            throw po::invalid_option_value(profile);
+    }
+    catch(po::error& e)
+    {
+        std::cerr << "ArgumentError: " << e.what() << "\n\n"
+                  << desc << std::endl;
+        return 1;
+    }
+
+    MockServer server(options, port);
+    server.run();
+    return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+
+/// folds A-Z only, nick completion, mentions and search all compare this way
+inline char asciiLower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline unsigned char asciiLower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+/// what mentions and search words are made of, bytes of UTF-8 sequences
+/// count as word characters
+inline bool isWordChar(char c)
+{
+    const unsigned char u = static_cast<unsigned char>(c);
+    return (u >= '0' && u <= '9') || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u == '_' || u >= 0x80;
+}
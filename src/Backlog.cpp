@@ -0,0 +1,349 @@
+#include "Backlog.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+/// sequences of prepended messages stay above 0, even without a capacity
+constexpr uint64_t MaxSequenceBase = uint64_t(1) << 62;
+
+constexpr size_t MinChunkSize = 4096;
+
+/// small budgets get small chunks, so releasing one drops few messages
+size_t chunkSizeFor(size_t byteBudget)
+{
+    return byteBudget > 0 ? std::clamp<size_t>(byteBudget / 64, MinChunkSize, 64 * 1024) : 64 * 1024;
+}
+
+}
+
+Backlog::Backlog(size_t capacity, size_t byteBudget, WorkerPool* workers, std::function<void()> onRewrapped)
+    : maxSize(capacity > 0 ? capacity : std::numeric_limits<size_t>::max())
+    , byteBudget(byteBudget)
+    , messageWidth(0)
+    , head(0)
+    , count(0)
+    , pushed(std::min<uint64_t>(maxSize, MaxSequenceBase))
+    , ring()
+    , index()
+    , arena(chunkSizeFor(byteBudget))
+    , referenced(0)
+    , lineArena(chunkSizeFor(byteBudget), arena.sharedSpares()) // text chunks dropped for lines come back
+    , lineBytes(0)
+    , wrapScratch()
+    , workers(workers)
+    , onRewrapped(std::move(onRewrapped))
+    , generation(0)
+    , rewrapCursor(0)
+    , pendingBatches(0)
+    , inFlightOldest(0)
+    , rewrap(std::make_unique<Rewrap>())
+{
+}
+
+Backlog::~Backlog()
+{
+    if (rewrap) waitForBatches();
+}
+
+EventMessage Backlog::push(EventMessage&& message)
+{
+    const uint64_t sequence = pushed;
+    const std::string_view text = arena.copy(message.message, sequence);
+    if (count == maxSize) dropOldest(); // the oldest slot becomes the newest one
+    if (count == ring.size() && head == 0)
+    {
+        ring.emplace_back();
+        index.push_back(0);
+    }
+    else if (count == ring.size())
+    {
+        reserveSlots(1, 0); // older messages used up the free slots
+    }
+    ++pushed;
+    ++count;
+    ring[slotOf(0)].assign(message, text);
+    referenced += text.size();
+    wrap(0);
+
+    if (overBudget())
+    {
+        // the ring keeps its slots, freed ones are filled before recycling
+        maxSize = ring.size();
+        while (overBudget() && count > 1)
+        {
+            dropOldest();
+            arena.releaseBefore(oldestSequence());
+        }
+    }
+    arena.releaseBefore(oldestSequence());
+    return std::move(message);
+}
+
+size_t Backlog::prepend(const std::vector<EventMessage>& older)
+{
+    const size_t limit = std::min<uint64_t>(std::min(older.size(), maxSize - count), oldestSequence());
+    size_t added = 0;
+    size_t addedBytes = 0;
+    for (; added < limit; ++added)
+    {
+        const size_t slot = added < ring.size() - count ? 0 : sizeof(BacklogMessage);
+        const size_t bytes = slot + older[older.size() - 1 - added].message.size();
+        if (byteBudget > 0 && this->bytes() + addedBytes + bytes > byteBudget) break;
+        addedBytes += bytes;
+    }
+    if (added == 0) return 0;
+    if (ring.size() - count < added) reserveSlots(added - (ring.size() - count), addedBytes);
+
+    // newest first, each one takes the free slot before the oldest
+    for (size_t i = 0; i < added; ++i)
+    {
+        const EventMessage& message = older[older.size() - 1 - i];
+        head = (head + ring.size() - 1) % ring.size();
+        ++count;
+        const std::string_view text = arena.copy(message.message, oldestSequence());
+        ring[head].assign(message, text);
+        referenced += text.size();
+        wrap(count - 1);
+    }
+    return added;
+}
+
+void Backlog::setWidth(size_t width)
+{
+    if (width == messageWidth) return;
+    messageWidth = width;
+    // no message reads lines of an older generation again
+    ++generation;
+    lineArena.clear();
+    lineBytes = 0;
+    rewrapCursor = pushed;
+}
+
+void Backlog::rewrapVisible(size_t lineFromBottom, size_t rows)
+{
+    const Position start = seek(lineFromBottom);
+    // the messages below the viewport decide where it starts
+    size_t wrapped = 0;
+    for (size_t message = start.message; message > 0 && wrapped < rows;)
+        wrapped += wrap(--message);
+    // the viewport and one more screen to scroll into
+    wrapped = 0;
+    for (size_t message = start.message; message < count && wrapped < 2 * rows; ++message)
+        wrapped += wrap(message);
+}
+
+bool Backlog::update()
+{
+    std::vector<std::shared_ptr<Batch>> finished;
+    {
+        std::lock_guard lock(rewrap->mutex);
+        finished.swap(rewrap->done);
+    }
+    bool changed = false;
+    for (auto& batch : finished)
+    {
+        --pendingBatches;
+        if (batch->generation != generation) continue;
+        for (size_t i = 0; i < batch->sequences.size(); ++i)
+        {
+            const uint64_t sequence = batch->sequences[i];
+            if (sequence < oldestSequence()) continue; // evicted meanwhile
+            const size_t slot = slotOf(pushed - 1 - sequence);
+            if (ring[slot].wrappedGeneration() == generation) continue; // was on screen
+            changed = setLines(slot, batch->lines[i]) || changed;
+        }
+    }
+    while (pendingBatches < MaxBatchesInFlight && rewrapCursor > oldestSequence())
+        submitBatch();
+    return changed;
+}
+
+LineSpan Backlog::lines(size_t message)
+{
+    wrap(message);
+    return fromNewest(message).getLines();
+}
+
+Backlog::Position Backlog::seek(size_t lineFromBottom) const
+{
+    const size_t total = totalLines();
+    if (lineFromBottom >= total) return {count, total};
+
+    // the ring is laid out as [head, size) followed by [0, head)
+    const size_t fromTop = total - 1 - lineFromBottom;
+    const size_t beforeHead = index.prefix(head);
+    const size_t afterHead = total - beforeHead;
+    const size_t slot = fromTop < afterHead
+                        ? index.find(beforeHead + fromTop)
+                        : index.find(fromTop - afterHead);
+    const size_t logical = (slot + ring.size() - head) % ring.size();
+    return {count - 1 - logical, total - linesOfOldest(logical + 1)};
+}
+
+Backlog::Anchor Backlog::anchorAt(size_t lineFromBottom) const
+{
+    if (count == 0) return {pushed, 0};
+    Position position = seek(lineFromBottom);
+    if (position.message == count)
+    {
+        // past the top, stick to the oldest message
+        position.message = count - 1;
+        position.linesBelow = totalLines() - linesOfOldest(1);
+    }
+    return {pushed - 1 - position.message, lineFromBottom - position.linesBelow};
+}
+
+size_t Backlog::lineOf(const Anchor& anchor) const
+{
+    if (anchor.sequence >= pushed) return 0;
+    if (anchor.sequence < oldestSequence()) return totalLines();
+    const size_t message = pushed - 1 - anchor.sequence;
+    const size_t linesBelow = totalLines() - linesOfOldest(count - message);
+    const size_t lines = ring[slotOf(message)].wrappedLines();
+    return linesBelow + std::min(anchor.line, lines > 0 ? lines - 1 : 0);
+}
+
+size_t Backlog::linesOfOldest(size_t messages) const
+{
+    if (head + messages <= ring.size())
+        return index.prefix(head + messages) - index.prefix(head);
+    return totalLines() - index.prefix(head) + index.prefix(head + messages - ring.size());
+}
+
+size_t Backlog::wrap(size_t message)
+{
+    const size_t slot = slotOf(message);
+    BacklogMessage& backlogMessage = ring[slot];
+    if (backlogMessage.wrappedGeneration() != generation)
+    {
+        BacklogMessage::wrap(backlogMessage.getText(), backlogMessage.getPrefixLength(), messageWidth, wrapScratch);
+        setLines(slot, wrapScratch);
+    }
+    return backlogMessage.wrappedLines();
+}
+
+bool Backlog::setLines(size_t slot, const std::vector<LineSlice>& lines)
+{
+    BacklogMessage& message = ring[slot];
+    const size_t oldLines = message.wrappedLines();
+    message.setLines(generation, lines, lineArena);
+    lineBytes += message.lineBytes();
+    index.add(slot, message.wrappedLines() - oldLines);
+
+    // dropped messages left more than the live lines behind, and enough
+    // that walking the ring costs little per dropped message
+    if (lineArena.stats().used - lineBytes > lineBytes + count * sizeof(LineSlice) + MinChunkSize)
+    {
+        lineArena.compact(
+            [this]
+            {
+                for (size_t m = 0; m < count; ++m)
+                {
+                    BacklogMessage& kept = ring[slotOf(m)];
+                    if (kept.wrappedGeneration() == generation) kept.moveLines(lineArena);
+                }
+            });
+    }
+    return message.wrappedLines() != oldLines;
+}
+
+ChunkArena::Stats Backlog::arenaStats() const
+{
+    const ChunkArena::Stats& texts = arena.stats();
+    const ChunkArena::Stats& lines = lineArena.stats();
+    return {texts.chunks + lines.chunks, texts.reserved + lines.reserved,
+            texts.used + lines.used, texts.released + lines.released};
+}
+
+void Backlog::dropOldest()
+{
+    // workers must not read texts whose chunk may be released
+    if (pendingBatches > 0 && oldestSequence() >= inFlightOldest) waitForBatches();
+    BacklogMessage& oldest = ring[head];
+    referenced -= oldest.getText().size();
+    if (oldest.wrappedGeneration() == generation) lineBytes -= oldest.lineBytes();
+    index.add(head, 0 - oldest.wrappedLines());
+    oldest.clear();
+    head = (head + 1) % ring.size();
+    --count;
+}
+
+void Backlog::reserveSlots(size_t needed, size_t pendingBytes)
+{
+    size_t spare = std::min(count / 2, maxSize - ring.size() - needed);
+    if (byteBudget > 0)
+    {
+        const size_t used = bytes() + pendingBytes + needed * sizeof(BacklogMessage);
+        spare = std::min(spare, used < byteBudget ? (byteBudget - used) / sizeof(BacklogMessage) : 0);
+    }
+    grow(ring.size() + needed + spare);
+}
+
+void Backlog::grow(size_t slots)
+{
+    std::vector<BacklogMessage> grown(slots);
+    std::vector<size_t> lines(slots, 0);
+    for (size_t message = 0; message < count; ++message)
+    {
+        BacklogMessage& oldest = ring[slotOf(count - 1 - message)];
+        lines[message] = oldest.wrappedLines();
+        grown[message] = std::move(oldest);
+    }
+    ring.swap(grown);
+    head = 0;
+    index.build(lines);
+}
+
+void Backlog::submitBatch()
+{
+    const uint64_t oldest = oldestSequence();
+    if (!workers)
+    {
+        for (; rewrapCursor > oldest; --rewrapCursor)
+            wrap(pushed - rewrapCursor);
+        return;
+    }
+
+    auto batch = std::make_shared<Batch>();
+    batch->generation = generation;
+    batch->width = messageWidth;
+    while (rewrapCursor > oldest && batch->texts.size() < BatchSize)
+    {
+        const uint64_t sequence = --rewrapCursor;
+        const BacklogMessage& message = ring[slotOf(pushed - 1 - sequence)];
+        if (message.wrappedGeneration() == generation) continue;
+        batch->sequences.push_back(sequence);
+        batch->texts.push_back(message.getText());
+        batch->prefixLengths.push_back(message.getPrefixLength());
+    }
+    if (batch->texts.empty()) return;
+    batch->lines.resize(batch->texts.size());
+    inFlightOldest = batch->sequences.back();
+    ++pendingBatches;
+    {
+        std::lock_guard lock(rewrap->mutex);
+        ++rewrap->inFlight;
+    }
+    workers->post(
+        [rewrap = rewrap.get(), batch, wake = onRewrapped]
+        {
+            for (size_t i = 0; i < batch->texts.size(); ++i)
+                BacklogMessage::wrap(batch->texts[i], batch->prefixLengths[i], batch->width, batch->lines[i]);
+            {
+                std::lock_guard lock(rewrap->mutex);
+                rewrap->done.push_back(batch);
+                --rewrap->inFlight;
+                // under the lock, the backlog may be gone right after
+                rewrap->finished.notify_all();
+            }
+            if (wake) wake();
+        });
+}
+
+void Backlog::waitForBatches()
+{
+    std::unique_lock lock(rewrap->mutex);
+    rewrap->finished.wait(lock, [this]{ return rewrap->inFlight == 0; });
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BacklogMessage.hpp"
+#include "ChunkArena.hpp"
+#include "FenwickTree.hpp"
+#include "WorkerPool.hpp"
+
+
+/// Chat history of one channel. A ring of at most capacity messages, the
+/// oldest one is recycled once it is full. A Fenwick tree over the wrapped
+/// line counts maps a scroll position to its message in O(log n), so a
+/// redraw only touches what is on screen.
+///
+/// Texts are copied into a ChunkArena, the ring only holds fixed size
+/// entries. With a byte budget the oldest messages are dropped until the
+/// arena gives back enough chunks, from then on the ring keeps its number
+/// of slots. Wrapped lines go to an arena of their own, cleared on every
+/// width change and compacted once most of it belongs to dropped messages.
+///
+/// A width change rewraps lazily: rewrapVisible() wraps the messages around
+/// the viewport right away, the rest is wrapped on the worker pool and
+/// merged into the index by update(). Until then a message keeps the line
+/// count of its previous width.
+///
+/// While there is room, older messages can be added above the oldest one,
+/// e.g. history paged in from disk, dropped messages included. They take
+/// free slots in front of it, the ring grows by half its size when there
+/// are none, so a page costs the same however long the backlog is.
+class Backlog
+{
+public:
+    /// where a line counted from the bottom of the backlog lies
+    struct Position
+    {
+        /// message index counted from the newest one, size() past the oldest
+        size_t message;
+        /// lines of all messages newer than it
+        size_t linesBelow;
+    };
+    /// a line that stays put while the lines below it change
+    struct Anchor
+    {
+        uint64_t sequence;
+        size_t line;
+    };
+
+    /// capacity and byteBudget may be 0 for no limit, workers may be null to
+    /// rewrap everything on the calling thread, onRewrapped is called from a
+    /// worker when update() has work to merge
+    Backlog(size_t capacity, size_t byteBudget, WorkerPool* workers, std::function<void()> onRewrapped);
+    Backlog(Backlog&&) = default;
+    ~Backlog();
+
+    /// adds the newest message, the event is returned to reuse its buffers
+    EventMessage push(EventMessage&& message);
+    /// copies the newest of messages older than all others, oldest first,
+    /// as many as still fit, returns how many
+    size_t prepend(const std::vector<EventMessage>& older);
+    /// starts rewrapping when the width changed
+    void setWidth(size_t messageWidth);
+    /// wraps the rows around the viewport ending at lineFromBottom now
+    void rewrapVisible(size_t lineFromBottom, size_t rows);
+    /// merges finished background work and hands out more, true if line counts changed
+    bool update();
+    inline bool rewrapping() const { return rewrapCursor > oldestSequence() || pendingBatches > 0; }
+
+    inline size_t size() const { return count; }
+    inline size_t capacity() const { return maxSize; }
+    /// older messages can still be added in front
+    inline bool roomForOlder() const { return count < maxSize && !overBudget(); }
+    /// arena bytes the messages refer to, the rest of the used bytes belong to dropped ones
+    inline size_t liveBytes() const { return referenced + lineBytes; }
+    /// of both arenas
+    ChunkArena::Stats arenaStats() const;
+    /// bytes counted against the budget
+    inline size_t bytes() const
+    {
+        return arena.stats().reserved + lineArena.stats().reserved + ring.size() * sizeof(BacklogMessage);
+    }
+    /// 0 for no limit
+    inline size_t budget() const { return byteBudget; }
+    /// what adding a message takes at least
+    static inline size_t bytesOf(const EventMessage& message) { return sizeof(BacklogMessage) + message.message.size(); }
+    inline size_t width() const { return messageWidth; }
+    inline size_t totalLines() const { return index.prefix(index.size()); }
+
+    /// a message keeps its sequence, newer ones have higher sequences
+    inline uint64_t oldestSequence() const { return pushed - count; }
+    /// sequence the next message pushed gets
+    inline uint64_t nextSequence() const { return pushed; }
+    /// 0 is the newest message
+    inline BacklogMessage& fromNewest(size_t message)
+    {
+        return ring[slotOf(message)];
+    }
+    /// wrapped lines of a message for the current width
+    LineSpan lines(size_t message);
+    Position seek(size_t lineFromBottom) const;
+    Anchor anchorAt(size_t lineFromBottom) const;
+    size_t lineOf(const Anchor& anchor) const;
+
+private:
+    static constexpr size_t BatchSize = 256;
+    static constexpr size_t MaxBatchesInFlight = 4;
+
+    /// messages wrapped by a worker, newest first
+    struct Batch
+    {
+        uint32_t generation;
+        size_t width;
+        std::vector<uint64_t> sequences;
+        /// in the arena, whose chunks outlive the batch
+        std::vector<std::string_view> texts;
+        std::vector<size_t> prefixLengths;
+        std::vector<std::vector<LineSlice>> lines;
+    };
+    /// shared with the workers
+    struct Rewrap
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::vector<std::shared_ptr<Batch>> done;
+        size_t inFlight = 0;
+    };
+
+    inline size_t slotOf(size_t message) const { return (head + count - 1 - message) % ring.size(); }
+    inline bool overBudget() const { return byteBudget > 0 && bytes() > byteBudget; }
+    /// empties the slot of the oldest message
+    void dropOldest();
+    /// makes room for needed more messages and as many spare slots as the
+    /// budget allows, up to half the size, pendingBytes are yet to be copied
+    void reserveSlots(size_t needed, size_t pendingBytes);
+    /// moves the messages to a ring of slots entries, oldest in slot 0
+    void grow(size_t slots);
+    /// lines of the oldest messages
+    size_t linesOfOldest(size_t messages) const;
+    /// wraps a message for the current width, returns its line count
+    size_t wrap(size_t message);
+    /// takes lines wrapped for the current width, true if their count changed
+    bool setLines(size_t slot, const std::vector<LineSlice>& lines);
+    void submitBatch();
+    /// blocks until the workers no longer read any message
+    void waitForBatches();
+
+    size_t maxSize;
+    size_t byteBudget;
+    size_t messageWidth;
+    /// physical slot of the oldest message
+    size_t head;
+    /// messages in the ring, slots after the newest one are free
+    size_t count;
+    /// sequence of the next message, starts at capacity to leave room for
+    /// prepended ones below the first
+    uint64_t pushed;
+    std::vector<BacklogMessage> ring;
+    /// wrapped line counts by physical slot
+    FenwickTree<size_t> index;
+    /// texts, tagged with the sequence of their message
+    ChunkArena arena;
+    /// bytes of the texts
+    size_t referenced;
+    /// lines of the current generation
+    ChunkArena lineArena;
+    size_t lineBytes;
+    /// reused for every wrap on this thread
+    std::vector<LineSlice> wrapScratch;
+
+    WorkerPool* workers;
+    std::function<void()> onRewrapped;
+    /// bumped by every width change, older batches and lines are dropped
+    uint32_t generation;
+    /// messages older than this sequence still wait for a batch
+    uint64_t rewrapCursor;
+    /// batches handed out and not merged yet
+    size_t pendingBatches;
+    /// oldest sequence any pending batch reads
+    uint64_t inFlightOldest;
+    std::unique_ptr<Rewrap> rewrap;
+};
@@ -0,0 +1,72 @@
+#include "BacklogMessage.hpp"
+
+BacklogMessage::BacklogMessage()
+    : time(0)
+    , sender()
+    , trip()
+    , flags()
+    , timeLength(0)
+    , prefixLength(0)
+    , timeText()
+    , text()
+    , lineCount(0)
+    , firstLine{0, 0}
+    , moreLines(nullptr)
+    , generation(0)
+{
+}
+void BacklogMessage::assign(const EventMessage& event, std::string_view messageText)
+{
+    time = event.time;
+    sender = event.sender;
+    trip = event.trip;
+    flags = event.flags;
+    timeLength = 0;
+    const bool isMe = flags.me;
+    const bool isWhisper = flags.whisper;
+    prefixLength = static_cast<uint16_t>((trip.empty() ? 0 : trip.size()+1)
+                                         + ((isMe || isWhisper) ? 0 : sender.size() + 3));
+    text = messageText;
+    lineCount = 0;
+    moreLines = nullptr;
+    generation = 0;
+}
+void BacklogMessage::clear()
+{
+    *this = BacklogMessage();
+}
+std::string_view BacklogMessage::getTimeText(const TimeFormat& format)
+{
+    if (timeLength == 0)
+    {
+        format.format(time, timeText.data());
+        timeLength = static_cast<uint8_t>(format.width());
+    }
+    return std::string_view(timeText.data(), timeLength);
+}
+void BacklogMessage::setLines(uint32_t wrapGeneration, const std::vector<LineSlice>& lines, ChunkArena& arena)
+{
+    lineCount = static_cast<uint32_t>(lines.size());
+    if (lines.size() == 1) firstLine = lines[0];
+    if (lines.size() > 1)
+    {
+        LineSlice* data = static_cast<LineSlice*>(arena.allocate(lines.size() * sizeof(LineSlice), alignof(LineSlice), 0));
+        std::copy(lines.begin(), lines.end(), data);
+        moreLines = data;
+    }
+    generation = wrapGeneration;
+}
+void BacklogMessage::moveLines(ChunkArena& arena)
+{
+    if (lineCount < 2) return;
+    LineSlice* data = static_cast<LineSlice*>(arena.allocate(lineBytes(), alignof(LineSlice), 0));
+    std::copy(moreLines, moreLines + lineCount, data);
+    moreLines = data;
+}
+void BacklogMessage::wrap(std::string_view text, size_t prefixLength, size_t maxMessageWidth, std::vector<LineSlice>& lines)
+{
+    lines.clear();
+    // only do updates if there is enough space to display anything
+    if (maxMessageWidth > prefixLength)
+        wrapLines(text, maxMessageWidth - prefixLength, maxMessageWidth, lines);
+}
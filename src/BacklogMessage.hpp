@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "ChunkArena.hpp"
+#include "HarpoonEvents.hpp"
+#include "InlineString.hpp"
+#include "InternedString.hpp"
+#include "LineWrapper.hpp"
+#include "TimeFormat.hpp"
+
+
+/// A message in the chat backlog. Its text and wrapped lines live in the
+/// backlog's arenas, only a single line is kept in place. Caches its lines
+/// for the last wrap generation, i.e. width.
+class BacklogMessage
+{
+public:
+    BacklogMessage();
+    /// reuses this entry for event, whose text was copied to the arena
+    void assign(const EventMessage& event, std::string_view text);
+    /// leaves an empty slot
+    void clear();
+
+    inline std::string_view getText() const { return text; }
+    inline std::string_view getLine(const LineSlice& line) const { return text.substr(line.offset, line.length); }
+    inline int64_t getTime() const { return time; }
+    inline std::string_view getSender() const { return sender.view(); }
+    inline std::string_view getTrip() const { return trip.view(); }
+    inline EventMessage::Flags getFlags() const { return flags; }
+    inline size_t getPrefixLength() const { return prefixLength; }
+    /// formatted on first use, the format must not change afterwards
+    std::string_view getTimeText(const TimeFormat& format);
+
+    /// generation of the current wrap, 0 until wrapped
+    inline uint32_t wrappedGeneration() const { return generation; }
+    inline size_t wrappedLines() const { return lineCount; }
+    /// only while the arena they were copied to keeps them
+    inline LineSpan getLines() const { return {lineCount > 1 ? moreLines : &firstLine, lineCount}; }
+    /// takes lines wrapped in this generation, more than one are copied to the arena
+    void setLines(uint32_t generation, const std::vector<LineSlice>& lines, ChunkArena& arena);
+    /// copies the lines kept in an arena to another one
+    void moveLines(ChunkArena& arena);
+    /// arena bytes of the current lines
+    inline size_t lineBytes() const { return lineCount > 1 ? lineCount * sizeof(LineSlice) : 0; }
+
+    /// only reads its arguments, so it may run on another thread
+    static void wrap(std::string_view text, size_t prefixLength, size_t messageWidth, std::vector<LineSlice>& lines);
+
+private:
+    int64_t time;
+    InternedString sender;
+    InlineString<7> trip;
+    EventMessage::Flags flags;
+    uint8_t timeLength;
+    uint16_t prefixLength;
+    std::array<char, TimeFormat::MaxLength> timeText;
+    std::string_view text;
+    uint32_t lineCount;
+    LineSlice firstLine;
+    const LineSlice* moreLines;
+    uint32_t generation;
+};
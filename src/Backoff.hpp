@@ -0,0 +1,52 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+
+/// Exponential backoff with jitter. Every delay is at least half of the
+/// current step, so clients that lost the connection at the same time
+/// spread out without retrying instantly.
+class Backoff
+{
+public:
+    using Duration = std::chrono::milliseconds;
+
+    inline Backoff(Duration initial, Duration maximum)
+        : initial(initial)
+        , maximum(maximum)
+        , step(initial)
+        , retries(0)
+        , random(std::random_device()())
+    {
+    }
+
+    /// delay before the next attempt, grows the step
+    inline Duration next()
+    {
+        const Duration::rep half = step.count() / 2;
+        const Duration delay(half + std::uniform_int_distribution<Duration::rep>(0, step.count() - half)(random));
+        step = std::min(maximum, step * 2);
+        ++retries;
+        return delay;
+    }
+
+    inline void reset()
+    {
+        step = initial;
+        retries = 0;
+    }
+
+    /// attempts since the last reset()
+    inline unsigned attempts() const
+    {
+        return retries;
+    }
+
+private:
+    Duration initial;
+    Duration maximum;
+    Duration step;
+    unsigned retries;
+    std::mt19937 random;
+};
@@ -0,0 +1,78 @@
+#include "ChunkArena.hpp"
+
+ChunkArena::ChunkArena(size_t chunkSize, std::shared_ptr<Spares> spares)
+    : chunkSize(chunkSize)
+    , chunks()
+    , first(0)
+    , spares(std::move(spares))
+    , sealed(0)
+    , current{0, 0, 0, 0}
+{
+}
+
+void* ChunkArena::allocate(size_t size, size_t align, uint64_t tag)
+{
+    if (chunks.size() - first > sealed)
+    {
+        Chunk& last = chunks.back();
+        const size_t start = (last.used + align - 1) & ~(align - 1);
+        if (start + size <= last.size)
+        {
+            current.used += start + size - last.used;
+            last.used = start + size;
+            if (tag > last.newestTag) last.newestTag = tag;
+            return last.data.get() + start;
+        }
+    }
+
+    // large ones get a chunk of their own, it goes with its message
+    const size_t bytes = size > chunkSize / 4 ? size : chunkSize;
+    std::unique_ptr<char[]> data;
+    if (bytes == chunkSize && !spares->chunks.empty())
+    {
+        data = std::move(spares->chunks.back());
+        spares->chunks.pop_back();
+    }
+    else
+    {
+        data = std::make_unique<char[]>(bytes);
+    }
+    if (first > 0 && chunks.size() == chunks.capacity())
+    {
+        chunks.erase(chunks.begin(), chunks.begin() + first);
+        first = 0;
+    }
+    chunks.push_back({std::move(data), bytes, size, tag});
+    ++current.chunks;
+    current.reserved += bytes;
+    current.used += size;
+    return chunks.back().data.get();
+}
+
+void ChunkArena::releaseBefore(uint64_t tag)
+{
+    while (first < chunks.size() && chunks[first].newestTag < tag)
+        releaseFront();
+}
+
+void ChunkArena::clear()
+{
+    while (first < chunks.size())
+        releaseFront();
+}
+
+void ChunkArena::releaseFront()
+{
+    Chunk& chunk = chunks[first++];
+    --current.chunks;
+    current.reserved -= chunk.size;
+    current.used -= chunk.used;
+    ++current.released;
+    if (chunk.size == chunkSize && spares->chunks.size() < spares->limit) spares->chunks.push_back(std::move(chunk.data));
+    chunk.data.reset();
+    if (first == chunks.size())
+    {
+        chunks.clear();
+        first = 0;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+/// Bump allocator over chunks that are given back whole, oldest first.
+/// Every allocation is tagged, e.g. with the backlog sequence of its
+/// message, a chunk is released once all its tags are older than the
+/// oldest message still kept. Nothing is freed on its own, replaced data
+/// stays in its chunk until that goes or the arena is cleared.
+class ChunkArena
+{
+public:
+    static constexpr size_t MinSpares = 2;
+
+    struct Stats
+    {
+        size_t chunks;
+        /// bytes of all chunks
+        size_t reserved;
+        /// bytes handed out from them, the rest is chunk tails
+        size_t used;
+        /// chunks released since the start
+        size_t released;
+    };
+
+    /// released chunks of one size kept for reuse, e.g. shared by the
+    /// arenas of one owner so what one gives back the other can take
+    struct Spares
+    {
+        std::vector<std::unique_ptr<char[]>> chunks;
+        /// kept at most, not counted as reserved
+        size_t limit = MinSpares;
+    };
+
+    explicit ChunkArena(size_t chunkSize = 64 * 1024, std::shared_ptr<Spares> spares = std::make_shared<Spares>());
+    ChunkArena(ChunkArena&&) = default;
+    ChunkArena& operator=(ChunkArena&&) = default;
+
+    void* allocate(size_t size, size_t align, uint64_t tag);
+    inline std::string_view copy(std::string_view text, uint64_t tag)
+    {
+        if (text.empty()) return {};
+        char* data = static_cast<char*>(allocate(text.size(), 1, tag));
+        std::copy(text.begin(), text.end(), data);
+        return std::string_view(data, text.size());
+    }
+    /// releases the oldest chunks whose tags are all below tag
+    void releaseBefore(uint64_t tag);
+    /// releases all chunks
+    void clear();
+    /// copies what is still used to new chunks and releases the others,
+    /// copyLive() has to allocate every live block again and copy it
+    template<class CopyLive>
+    void compact(CopyLive&& copyLive)
+    {
+        sealed = chunks.size() - first;
+        copyLive();
+        // the old chunks were reserved a moment ago, keeping them stays within that
+        spares->limit = std::max(spares->limit, sealed);
+        for (; sealed > 0; --sealed)
+            releaseFront();
+    }
+
+    inline const Stats& stats() const { return current; }
+    inline const std::shared_ptr<Spares>& sharedSpares() const { return spares; }
+
+private:
+    void releaseFront();
+
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+        size_t used;
+        uint64_t newestTag;
+    };
+
+    size_t chunkSize;
+    /// in the order they were filled from first on, allocations go to the
+    /// last one; released ones are erased in bulk so the vector keeps its
+    /// capacity instead of allocating like a deque would
+    std::vector<Chunk> chunks;
+    size_t first;
+    /// released chunks of the default size, reused before allocating
+    std::shared_ptr<Spares> spares;
+    /// oldest chunks that take no more allocations while compacting
+    size_t sealed;
+    Stats current;
+};
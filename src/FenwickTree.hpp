@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+
+/// Binary indexed tree over unsigned counts. Point updates, prefix sums
+/// and searching for a cumulative count take O(log n). Negative deltas
+/// are passed as their unsigned wrap-around, the sums stay exact.
+template<class T>
+class FenwickTree
+{
+public:
+    inline size_t size() const { return tree.size(); }
+
+    /// replaces all values in O(n)
+    inline void build(const std::vector<T>& values)
+    {
+        tree = values;
+        for (size_t i = 1; i <= tree.size(); ++i)
+        {
+            const size_t parent = i + (i & -i);
+            if (parent <= tree.size()) tree[parent-1] += tree[i-1];
+        }
+    }
+
+    /// appends a value in O(log n)
+    inline void push_back(T value)
+    {
+        // node i covers (i - lowbit(i), i], collect the part before i
+        const size_t i = tree.size() + 1;
+        const size_t stop = i - (i & -i);
+        for (size_t j = i - 1; j > stop; j -= j & -j)
+            value += tree[j-1];
+        tree.push_back(value);
+    }
+
+    inline void add(size_t index, T delta)
+    {
+        for (size_t i = index + 1; i <= tree.size(); i += i & -i)
+            tree[i-1] += delta;
+    }
+
+    /// sum of the first count values
+    inline T prefix(size_t count) const
+    {
+        T sum = 0;
+        for (size_t i = count; i > 0; i -= i & -i)
+            sum += tree[i-1];
+        return sum;
+    }
+
+    /// first index whose prefix including itself exceeds target, size() if none
+    inline size_t find(T target) const
+    {
+        size_t step = 1;
+        while (step * 2 <= tree.size()) step *= 2;
+        size_t position = 0;
+        for (; step > 0; step /= 2)
+        {
+            if (position + step <= tree.size() && tree[position+step-1] <= target)
+            {
+                position += step;
+                target -= tree[position-1];
+            }
+        }
+        return position;
+    }
+
+private:
+    std::vector<T> tree;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <type_traits>
+#include <variant>
+#include "HarpoonEventQueue.hpp"
+
+
+/// Consumer of the harpoon EventQueue
+class Frontend
+{
+public:
+    virtual ~Frontend() = default;
+
+    /// returns once the user quit or a termination signal arrived
+    virtual void join() = 0;
+    /// not thread safe, call after join()
+    virtual std::string describeStats() const = 0;
+
+    virtual void onInput(const EventInput&) = 0;
+    virtual void onUserList(EventUserList&&) = 0;
+    virtual void onUserChanged(const EventUserChanged&) = 0;
+    virtual void onMessage(EventMessage&&) = 0;
+
+protected:
+    inline void dispatch(Event& event)
+    {
+        std::visit(
+            [this](auto& e)
+            {
+                using Type = std::decay_t<decltype(e)>;
+                if constexpr(std::is_same_v<Type, EventInput>) return this->onInput(e);
+                if constexpr(std::is_same_v<Type, EventUserList>) return this->onUserList(std::move(e));
+                if constexpr(std::is_same_v<Type, EventUserChanged>) return this->onUserChanged(e);
+                if constexpr(std::is_same_v<Type, EventMessage>) return this->onMessage(std::move(e));
+            }, event);
+    }
+};
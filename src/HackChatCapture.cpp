@@ -0,0 +1,101 @@
+#include "HackChatCapture.hpp"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace hackchat
+{
+
+namespace
+{
+
+constexpr char magic[4] = {'H', 'C', 'A', 'P'};
+constexpr uint32_t version = 1;
+constexpr size_t recordHeaderSize = 1 + 2 + 8 + 4;
+
+template<class T>
+void put(std::string& out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out += static_cast<char>(static_cast<uint64_t>(value) >> (8 * i) & 0xff);
+}
+
+template<class T>
+T get(const char* in)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return static_cast<T>(value);
+}
+
+}
+
+
+CaptureWriter::CaptureWriter(const std::string& path)
+    : file(path, std::ios_base::binary | std::ios_base::trunc)
+{
+    if (!file) throw std::runtime_error("Failed to open capture file " + path);
+    buffer.reserve(FlushSize * 2);
+    buffer.append(magic, sizeof(magic));
+    put<uint32_t>(buffer, version);
+}
+CaptureWriter::~CaptureWriter()
+{
+    file.write(buffer.data(), buffer.size());
+}
+
+void CaptureWriter::channel(uint16_t id, std::string_view name)
+{
+    append(CaptureKind::Channel, id, name);
+}
+void CaptureWriter::frame(uint16_t channel, std::string_view payload)
+{
+    append(CaptureKind::Frame, channel, payload);
+}
+
+void CaptureWriter::append(CaptureKind kind, uint16_t channel, std::string_view payload)
+{
+    using namespace std::chrono;
+    std::lock_guard lock(mutex);
+    const int64_t time = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    put<uint8_t>(buffer, static_cast<uint8_t>(kind));
+    put<uint16_t>(buffer, channel);
+    put<int64_t>(buffer, time);
+    put<uint32_t>(buffer, static_cast<uint32_t>(payload.size()));
+    buffer.append(payload.data(), payload.size());
+    if (buffer.size() >= FlushSize)
+    {
+        file.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+CaptureReader::CaptureReader(const std::string& path, size_t maxPayload)
+    : path(path)
+    , maxPayload(maxPayload)
+    , file(path, std::ios_base::binary)
+{
+    char header[sizeof(magic) + 4];
+    if (!file.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0)
+        throw std::runtime_error("Not a capture file: " + path);
+    if (get<uint32_t>(header + sizeof(magic)) != version)
+        throw std::runtime_error("Unsupported capture version in " + path);
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+    char header[recordHeaderSize];
+    if (!file.read(header, sizeof(header))) return false;
+    record.kind = static_cast<CaptureKind>(get<uint8_t>(header));
+    record.channel = get<uint16_t>(header + 1);
+    record.time = get<int64_t>(header + 3);
+    const size_t length = get<uint32_t>(header + 11);
+    // checked before allocating, a corrupt length could ask for 4 GiB
+    if (length > maxPayload)
+        throw std::runtime_error("Corrupt capture file " + path + ": record of " + std::to_string(length) + " bytes");
+    record.payload.resize(length);
+    return static_cast<bool>(file.read(record.payload.data(), record.payload.size()));
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace hackchat
+{
+
+/// Capture file layout, all integers little endian:
+///   header  "HCAP" u32 version
+///   record  u8 kind, u16 channel, i64 time (us since epoch), u32 length, payload
+/// Channel records name the channel ids, they precede the frames.
+enum class CaptureKind : uint8_t
+{
+    Channel = 0,
+    Frame = 1,
+};
+
+struct CaptureRecord
+{
+    CaptureKind kind;
+    uint16_t channel;
+    int64_t time;
+    std::string payload;
+};
+
+/// Appends inbound frames of all connections to a capture file.
+/// Records are collected in a buffer and written in large blocks.
+class CaptureWriter
+{
+public:
+    explicit CaptureWriter(const std::string& path);
+    ~CaptureWriter();
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    /// may be called from any thread
+    void channel(uint16_t id, std::string_view name);
+    void frame(uint16_t channel, std::string_view payload);
+
+private:
+    static constexpr size_t FlushSize = 64 * 1024;
+
+    void append(CaptureKind kind, uint16_t channel, std::string_view payload);
+
+    std::mutex mutex;
+    std::ofstream file;
+    std::string buffer;
+};
+
+class CaptureReader
+{
+public:
+    /// records longer than maxPayload, e.g. the largest websocket message, are corrupt
+    CaptureReader(const std::string& path, size_t maxPayload);
+
+    /// false at the end of the file or on a truncated record, throws
+    /// std::runtime_error on a corrupt one
+    bool next(CaptureRecord& record);
+
+private:
+    std::string path;
+    size_t maxPayload;
+    std::ifstream file;
+};
+
+}
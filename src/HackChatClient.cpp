@@ -1,75 +1,217 @@
 #include "HackChatClient.hpp"
-#include <boost/date_time.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <string_view>
+#include "PerfectHash.hpp"
 #include "HackChatEvents.hpp"
 #include "HarpoonEvents.hpp"
 
 namespace hackchat
 {
 
+namespace
+{
+
+using FrameHandler = void (Client::*)(const Frame&);
 
-static boost::posix_time::ptime parseTime(boost::posix_time::ptime& result, const Json::Value& timeValue)
+struct Command
 {
-    if (timeValue.isIntegral())
-    {
-        try
-        {
-            std::time_t time = timeValue.asInt64() / 1000;
-            return boost::posix_time::from_time_t(time);
-        }
-        catch(...) { } // ignore otherwise
-    }
-    return boost::posix_time::ptime();
+    std::string_view name;
+    FrameHandler handler;
+};
+
+template<size_t N>
+constexpr std::array<std::string_view, N> commandNames(const Command (&commands)[N])
+{
+    std::array<std::string_view, N> names{};
+    for (size_t i = 0; i < N; ++i) names[i] = commands[i].name;
+    return names;
 }
 
+/// inbound commands, new ones only need an entry here
+constexpr Command commands[] = {
+    {"chat", &Client::onChat},
+    {"info", &Client::onInfo},
+    {"warn", &Client::onWarn},
+    {"emote", &Client::onEmote},
+    {"invite", &Client::onInvite},
+    {"captcha", &Client::onCaptcha},
+    {"onlineSet", &Client::onOnlineSet},
+    {"onlineAdd", &Client::onOnlineAdd},
+    {"onlineRemove", &Client::onOnlineRemove},
+};
+constexpr size_t commandCount = std::size(commands);
+constexpr PerfectHash<commandCount> commandIndex(commandNames(commands));
+static_assert(commandIndex.valid(), "no collision free hash for the command table");
+
+/// the type field of info frames
+constexpr Command infoTypes[] = {
+    {"whisper", &Client::onWhisper},
+    {"emote", &Client::onEmote},
+};
+constexpr size_t infoTypeCount = std::size(infoTypes);
+constexpr PerfectHash<infoTypeCount, 4> infoTypeIndex(commandNames(infoTypes));
+static_assert(infoTypeIndex.valid(), "no collision free hash for the info types");
 
-Client::Client(EventQueue& harpoon)
-    : harpoon(harpoon)
+}
+
+
+Client::Client(EventQueue& harpoon, boost::asio::io_service& io, TlsContext& tls, CaptureWriter* capture, uint16_t channelId)
+    : queue(strand, [this](HackChatEvent& event){ handleEvent(event); })
+    , harpoon(harpoon)
+    , tls(tls)
+    , capture(capture)
+    , channelId(channelId)
+    , strand(io)
+    , connected(false)
+    , sender(wss, strand, harpoon, channelId)
+    , pingTimer(io)
+    , deflate(false)
+    , wireBytes(0)
+    , decodedBytes(0)
+    , backoff(std::chrono::milliseconds(500), std::chrono::seconds(60))
+    , reconnectTimer(io)
+    , reconnecting(false)
+    , reconnects(0)
+    , reconnectAttempts(0)
+    , lastReconnect(0)
+    , totalReconnect(0)
+    , maxReconnect(0)
 {
-    wss.init_asio();
-    wss.start_perpetual();
+    wss.init_asio(&io);
     wss.clear_access_channels(websocketpp::log::alevel::all);
 
-    eventHandlerThread = NJThread(
-        "chatEventHandler",
-        [this]
+    // websocketpp calls these on any thread running the io_service,
+    // everything touching the connection state is moved onto the strand
+    wss.set_tls_init_handler(
+        [this](auto hdl)
+        {
+            return this->tls.context();
+        });
+    wss.set_socket_init_handler(
+        [this](auto hdl, auto& socket)
+        {
+            this->tls.prepare(socket.native_handle(), wss.get_con_from_hdl(hdl)->get_host());
+        });
+    wss.set_message_handler(
+        [this](auto hdl, WssMessagePtr msg)
+        {
+            const size_t compressed = msg->get_compressed() ? WssConfig::permessage_deflate_type::take() : 0;
+            strand.post(
+                [this, msg, compressed]
+                {
+                    const size_t size = msg->get_payload().size();
+                    wireBytes += compressed ? compressed : size;
+                    decodedBytes += size;
+                    onFrame(msg->get_raw_payload());
+                });
+        });
+    wss.set_open_handler(
+        [this](auto hdl)
+        {
+            auto con = wss.get_con_from_hdl(hdl);
+            const bool resumed = this->tls.finished(con->get_socket().native_handle());
+            const bool deflate = con->get_response_header("Sec-WebSocket-Extensions").find("permessage-deflate") != std::string::npos;
+            strand.post(
+                [this, hdl, resumed, deflate]
+                {
+                    wssHandle = hdl;
+                    onOpen(resumed, deflate);
+                });
+        });
+    wss.set_fail_handler(
+        [this](auto hdl)
+        {
+            strand.post(
+                [this]
+                {
+                    publish(EventMessage("system",
+                                         "cxn error on hack.chat...",
+                                         MessageType::Status));
+                    onHackDisconnected(EventHackDisconnected());
+                });
+        });
+    wss.set_close_handler(
+        [this](auto hdl)
         {
-            while (RUNNING)
-            {
-                if (const auto& optMessage = this->queue.pop())
-                    std::visit(
-                        [this](auto&& e)
-                        {
-                            using Type = std::decay_t<decltype(*e)>;
-                            if constexpr(std::is_same_v<Type, EventHackSendMessage>) return this->onHackSendMessage(*e);
-                            if constexpr(std::is_same_v<Type, EventHackConnect>) return this->onHackConnect(*e);
-                            if constexpr(std::is_same_v<Type, EventHackConnected>) return this->onHackConnected(*e);
-                            if constexpr(std::is_same_v<Type, EventHackDisconnect>) return this->onHackDisconnect(*e);
-                            if constexpr(std::is_same_v<Type, EventHackDisconnected>) return this->onHackDisconnected(*e);
-                        }, *optMessage);
-            }
+            strand.post([this]{ onHackDisconnected(EventHackDisconnected()); });
         });
 }
-Client::~Client()
+
+void Client::handleEvent(HackChatEvent& event)
 {
-    wss.stop_perpetual();
-    wss.stop();
-    connected = false;
-    std::lock_guard lock(wssPingMutex);
-    wssPingCondition.notify_all();
+    std::visit(
+        [this](auto& e)
+        {
+            using Type = std::decay_t<decltype(e)>;
+            if constexpr(std::is_same_v<Type, EventHackSendMessage>) return this->onHackSendMessage(e);
+            if constexpr(std::is_same_v<Type, EventHackConnect>) return this->onHackConnect(e);
+            if constexpr(std::is_same_v<Type, EventHackConnected>) return this->onHackConnected(e);
+            if constexpr(std::is_same_v<Type, EventHackDisconnect>) return this->onHackDisconnect(e);
+            if constexpr(std::is_same_v<Type, EventHackDisconnected>) return this->onHackDisconnected(e);
+        }, event);
 }
 
-void Client::onHackSendMessage(const EventHackSendMessage& event)
+void Client::scheduleReconnect()
 {
-    Json::Value root;
-    root["cmd"] = "chat";
-    root["text"] = event.message;
+    const Backoff::Duration delay = backoff.next();
+    ++reconnectAttempts;
+    char text[64];
+    std::snprintf(text, sizeof(text), "reconnecting to hack.chat in %.1fs...", delay.count() / 1000.0);
+    publish(EventMessage("system", text, MessageType::Status));
 
-    WssErrorCode ec;
-    wss.send(
-        wssHandle,
-        Json::writeString(Json::StreamWriterBuilder(), root),
-        websocketpp::frame::opcode::text,
-        ec);
+    reconnectTimer.expires_after(delay);
+    reconnectTimer.async_wait(strand.wrap(
+        [this](const boost::system::error_code& ec)
+        {
+            if (ec || !connected) return;
+            startConnect();
+        }));
+}
+
+void Client::onOpen(bool resumed, bool deflate)
+{
+    this->deflate = deflate;
+    publish(EventMessage("system",
+                         resumed ? "connected to hack.chat (resumed tls session)..." : "connected to hack.chat...",
+                         MessageType::Status));
+    if (reconnecting)
+    {
+        const auto took = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - disconnectedAt);
+        ++reconnects;
+        lastReconnect = took;
+        totalReconnect += took;
+        maxReconnect = std::max(maxReconnect, took);
+        reconnecting = false;
+    }
+    backoff.reset();
+    sender.open(wssHandle);
+    sender.sendJoin(channel, username + (password.empty() ? "" : "#" + password));
+    schedulePing();
+}
+
+void Client::schedulePing()
+{
+    pingTimer.expires_after(std::chrono::seconds(60));
+    pingTimer.async_wait(strand.wrap(
+        [this](const boost::system::error_code& ec)
+        {
+            if (ec || !connected) return;
+            sender.sendPing();
+            schedulePing();
+        }));
+}
+
+void Client::onHackSendMessage(const EventHackSendMessage& event)
+{
+    if (event.message == "/stats")
+    {
+        reportStats();
+        return;
+    }
+    sender.sendChat(event.message);
 }
 void Client::onHackConnect(const EventHackConnect& event)
 {
@@ -78,213 +220,213 @@ void Client::onHackConnect(const EventHackConnect& event)
     username = event.username;
     password = event.password;
 
-    harpoon.push(std::make_shared<EventMessage>(
+    publish(EventMessage(
         "system",
         "connecting to hack.chat " + server,
         MessageType::Status));
     connected = true;
-    wss.set_tls_init_handler(
-        [](auto hdl)
-        {
-            auto ctx = websocketpp::lib::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls);
-            ctx->set_options(boost::asio::ssl::context::default_workarounds |
-                             boost::asio::ssl::context::no_sslv2 |
-                             boost::asio::ssl::context::no_sslv3 |
-                             boost::asio::ssl::context::single_dh_use);
-            return ctx;
-        });
-    wss.set_message_handler(
-        [this](auto hdl, WssMessagePtr msg)
-        {
-            const std::string& payload = msg->get_payload();
+    reconnecting = false;
+    backoff.reset();
+    reconnectTimer.cancel();
+    startConnect();
+}
+void Client::startConnect()
+{
+    WssErrorCode ec;
+    auto con = wss.get_connection(server, ec);
+    if (ec)
+    {
+        connected = false;
+        publish(EventMessage("system",
+                             "failed to connect to hack.chat: " + ec.message(),
+                             MessageType::Status));
+        return;
+    }
+    wss.connect(con);
+}
 
-            try
-            {
-                Json::CharReaderBuilder builder;
-                const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
-                Json::Value root;
-                JSONCPP_STRING err;
-                if (!reader->parse(payload.c_str(), payload.c_str()+payload.size(), &root, &err)) return; // skip
+void Client::onFrame(std::string& payload)
+{
+    if (capture) capture->frame(channelId, payload);
+    if (!parser.parse(payload, frame)) return; // skip
 
-#ifdef USE_DEBUGLOG
-                std::ofstream("hack.log", std::ios_base::app) << payload << '\n';
-#endif
-                const std::string& cmd = root.get("cmd", "").asString();
+    static_assert(commandCount < MaxCommands, "too many commands for frameCounts");
+    const size_t index = commandIndex.find(frame.cmd);
+    frameCounts[index].fetch_add(1, std::memory_order_relaxed);
+    if (index == commandCount) return;
 
-                if (cmd == "chat")
-                {
-                    std::string text = root.get("text", "").asString();
-                    text.erase(std::remove(text.begin(), text.end(), '\0'), text.end()); // remove nullbytes
+    try
+    {
+        (this->*commands[index].handler)(frame);
+    }
+    catch(const std::exception& e)
+    {
+        publish(EventMessage("!!PARSE_ERROR!!", payload + ", " + e.what()));
+    }
+}
 
-                    auto event = std::make_shared<EventMessage>(root.get("nick", "system").asString(),
-                                                                text);
-                    parseTime(event->time, root["time"]);
+void Client::replayFrame(std::string payload, std::atomic<size_t>& inFlight)
+{
+    strand.post(
+        [this, payload = std::move(payload), &inFlight]() mutable
+        {
+            onFrame(payload);
+            inFlight.fetch_sub(1, std::memory_order_release);
+        });
+}
 
-                    event->extra["trip"] = root.get("trip", "").asString();
-                    event->extra["mod"] = root.get("mod", false).asBool() ? "1" : "";
+void Client::onChat(const Frame& frame)
+{
+    EventMessage event = harpoon.messages.acquire();
+    event.time = frame.hasTime ? frame.time : EventMessage::currentTime();
+    event.flags = EventMessage::Flags();
+    event.flags.mod = frame.mod;
+    event.sender = InternedString(frame.nick.empty() ? "system" : frame.nick);
+    event.trip.assign(frame.trip);
+    event.message.assign(frame.text);
+    event.message.erase(std::remove(event.message.begin(), event.message.end(), '\0'),
+                        event.message.end()); // remove nullbytes
 
-                    harpoon.push(event);
-                }
-                else if (cmd == "warn")
-                {
-                    auto event = std::make_shared<EventMessage>("system",
-                                                                root.get("text", "").asString(),
-                                                                MessageType::Status);
-                    parseTime(event->time, root["time"]);
-                    harpoon.push(event);
-                }
-                else if (cmd == "info")
-                {
-                    const std::string& type = root.get("type", "").asString();
-                    if (type == "whisper")
-                    {
-                        const std::string& nick = root.get("from", "").asString();
-                        const std::string& trip = root.get("trip", "").asString();
-                        const std::string& utype = root.get("utype", "").asString();
-                        auto event = std::make_shared<EventMessage>(nick,
-                                                                    root.get("text", "").asString(),
-                                                                    MessageType::Whisper);
-                        if (!trip.empty()) event->extra["trip"] = trip;
-                        if (utype == "mod") event->extra["mod"] = "1";
-                        harpoon.push(event);
-                    }
-                    else if (type == "emote")
-                    {
-                        const std::string& nick = root.get("nick", "").asString();
-                        harpoon.push(std::make_shared<EventMessage>(nick,
-                                                  root.get("text", "").asString(),
-                                                  MessageType::Me));
-                    }
-                }
-                else if (cmd == "onlineAdd")
-                {
-                    const std::string& nick = root.get("nick", "").asString();
-                    harpoon.push(std::make_shared<EventUserChanged>(nick, UserChangeType::Add));
-                    harpoon.push(std::make_shared<EventMessage>("system",
-                                              nick + " has joined the channel",
-                                              MessageType::Status));
-                }
-                else if (cmd == "onlineRemove")
-                {
-                    const std::string& nick = root.get("nick", "").asString();
-                    harpoon.push(std::make_shared<EventMessage>("system",
-                                              nick + " has left the channel",
-                                              MessageType::Status));
-                    harpoon.push(std::make_shared<EventUserChanged>(nick, UserChangeType::Remove));
-                }
-                else if (cmd == "onlineSet")
-                {
-                    const auto& nicksArrayValue = root["nicks"];
-                    if (nicksArrayValue.isArray())
-                    {
-                        std::vector<std::string> nicks(nicksArrayValue.size());
-                        for (int i = 0; i < static_cast<int>(nicksArrayValue.size()); ++i)
-                            nicks[i] = nicksArrayValue[i].asString();
-                        harpoon.push(std::make_shared<EventUserList>(std::move(nicks)));
-                    }
-                }
-            }
-            catch(const std::exception& e)
-            {
-                harpoon.push(std::make_shared<EventMessage>("!!PARSE_ERROR!!", payload + ", " + e.what()));
-            }
-        });
-    wss.set_open_handler(
-        [this](auto hdl)
-        {
-            wssHandle = hdl;
-            harpoon.push(std::make_shared<EventMessage>("system",
-                                      "connected to hack.chat...",
-                                      MessageType::Status));
-            Json::Value root;
-            root["cmd"] = "join";
-            root["channel"] = channel;
-            root["nick"] = username + (password.empty() ? "" : "#" + password);
+    publish(std::move(event));
+}
+void Client::onInfo(const Frame& frame)
+{
+    const size_t index = infoTypeIndex.find(frame.type);
+    if (index != infoTypeCount) (this->*infoTypes[index].handler)(frame);
+}
+void Client::onWhisper(const Frame& frame)
+{
+    EventMessage event(frame.from,
+                       std::string(frame.text),
+                       MessageType::Whisper);
+    if (frame.hasTime) event.time = frame.time;
+    event.trip.assign(frame.trip);
+    event.flags.mod = frame.utype == "mod";
+    publish(std::move(event));
+}
+void Client::onWarn(const Frame& frame)
+{
+    EventMessage event("system",
+                       std::string(frame.text),
+                       MessageType::Status);
+    if (frame.hasTime) event.time = frame.time;
+    publish(std::move(event));
+}
+void Client::onEmote(const Frame& frame)
+{
+    EventMessage event(frame.nick,
+                       std::string(frame.text),
+                       MessageType::Me);
+    if (frame.hasTime) event.time = frame.time;
+    event.trip.assign(frame.trip);
+    publish(std::move(event));
+}
+void Client::onInvite(const Frame& frame)
+{
+    const std::string_view target = frame.inviteChannel.empty() ? frame.channel : frame.inviteChannel;
+    publish(EventMessage("system",
+                         std::string(frame.from) + " invited you to ?" + std::string(target),
+                         MessageType::Status));
+}
+void Client::onCaptcha(const Frame& frame)
+{
+    publish(EventMessage("system",
+                         "captcha required, enter the text below:\n" + std::string(frame.text),
+                         MessageType::Status));
+}
+void Client::onOnlineSet(const Frame& frame)
+{
+    publish(EventUserList(std::vector<std::string>(frame.nicks.begin(), frame.nicks.end())));
+}
+void Client::onOnlineAdd(const Frame& frame)
+{
+    const std::string nick(frame.nick);
+    publish(EventUserChanged(nick, UserChangeType::Add));
+    publish(EventMessage("system",
+                         nick + " has joined the channel",
+                         MessageType::Status));
+}
+void Client::onOnlineRemove(const Frame& frame)
+{
+    const std::string nick(frame.nick);
+    publish(EventMessage("system",
+                         nick + " has left the channel",
+                         MessageType::Status));
+    publish(EventUserChanged(nick, UserChangeType::Remove));
+}
 
-            WssErrorCode ec;
-            wss.send(
-                hdl,
-                Json::writeString(Json::StreamWriterBuilder(), root),
-                websocketpp::frame::opcode::text,
-                ec);
-            if (ec)
-            {
-                harpoon.push(std::make_shared<EventMessage>("system",
-                                          "failed to send message to hack.chat: " + ec.message(),
-                                          MessageType::Status));
-            }
-            wssPingThread = NJThread("WssPing",
-                                     [this, hdl]
-                                     {
-                                         while (RUNNING && connected)
-                                         {
-                                             for (int i = 0; i < 60 && RUNNING; ++i)
-                                             {
-                                                 std::unique_lock lock(wssPingMutex);
-                                                 wssPingCondition.wait_for(lock, std::chrono::seconds(1));
-                                             }
-                                             if (!RUNNING || !connected) break;
-                                             WssErrorCode ec;
-                                             wss.send(
-                                                 hdl,
-                                                 "{\"cmd\": \"ping\"}",
-                                                 websocketpp::frame::opcode::text,
-                                                 ec);
-                                         }
-                                     });
-        });
-    wss.set_fail_handler(
-        [this](auto hdl)
-        {
-            harpoon.push(std::make_shared<EventMessage>("system",
-                                      "cxn error on hack.chat...",
-                                      MessageType::Status));
-        });
-    WssErrorCode ec;
-    auto con = wss.get_connection(server, ec);
-    if (ec)
+void Client::reportStats()
+{
+    std::string stats = "frames:";
+    for (size_t i = 0; i <= commandCount; ++i)
     {
-        connected = false;
-        harpoon.push(std::make_shared<EventMessage>("system",
-                                  "failed to connect to hack.chat: " + ec.message(),
-                                  MessageType::Status));
-        return;
+        const uint64_t count = frameCounts[i].load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        stats += ' ';
+        stats += i < commandCount ? commands[i].name : "unknown";
+        stats += '=';
+        stats += std::to_string(count);
     }
-    wss.connect(con);
-    wssThread = NJThread("WssThread", [this]{wss.run();});
+    publish(EventMessage("system", std::move(stats), MessageType::Status));
+    publish(EventMessage("system", sender.describeStats(), MessageType::Status));
+
+    char line[192];
+    std::snprintf(line, sizeof(line),
+                  "reconnect: count=%llu attempts=%llu last=%lldms avg=%lldms max=%lldms tls-resumed=%llu tls-full=%llu",
+                  static_cast<unsigned long long>(reconnects),
+                  static_cast<unsigned long long>(reconnectAttempts),
+                  static_cast<long long>(lastReconnect.count()),
+                  static_cast<long long>(reconnects ? totalReconnect.count() / reconnects : 0),
+                  static_cast<long long>(maxReconnect.count()),
+                  static_cast<unsigned long long>(tls.resumedCount()),
+                  static_cast<unsigned long long>(tls.fullCount()));
+    publish(EventMessage("system", line, MessageType::Status));
+
+    std::snprintf(line, sizeof(line),
+                  "transport: deflate=%s wire=%llu decoded=%llu ratio=%.2f",
+                  deflate ? "on" : "off",
+                  static_cast<unsigned long long>(wireBytes),
+                  static_cast<unsigned long long>(decodedBytes),
+                  decodedBytes ? static_cast<double>(wireBytes) / decodedBytes : 1.0);
+    publish(EventMessage("system", line, MessageType::Status));
 }
-            
+
 void Client::onHackConnected(const EventHackConnected& event)
 {
-    harpoon.push(std::make_shared<EventMessage>("system",
-                              "connected to hack.chat...",
-                              MessageType::Status));
+    publish(EventMessage("system",
+                         "connected to hack.chat...",
+                         MessageType::Status));
 }
 void Client::onHackDisconnect(const EventHackDisconnect& event)
 {
     connected = false;
-    harpoon.push(std::make_shared<EventMessage>("system",
-                              "disconnecting from hack.chat...",
-                              MessageType::Status));
+    reconnectTimer.cancel();
+    publish(EventMessage("system",
+                         "disconnecting from hack.chat...",
+                         MessageType::Status));
+    WssErrorCode ec;
+    wss.close(wssHandle, websocketpp::close::status::going_away, "", ec);
 }
 void Client::onHackDisconnected(const EventHackDisconnected& event)
 {
+    sender.close();
+    pingTimer.cancel();
+    wssHandle.reset();
     if (connected)
     {
-        harpoon.push(std::make_shared<EventMessage>("system",
-                                  "reconnecting to hack.chat...",
-                                  MessageType::Status));
-        queue.push(std::make_shared<EventHackConnect>(server, channel, username, password));
-        connected = false;
+        if (!reconnecting)
+        {
+            reconnecting = true;
+            disconnectedAt = std::chrono::steady_clock::now();
+        }
+        scheduleReconnect();
     }
     else
     {
-        harpoon.push(std::make_shared<EventMessage>("system",
-                                  "disconnected from hack.chat...",
-                                  MessageType::Status));
+        publish(EventMessage("system",
+                             "disconnected from hack.chat...",
+                             MessageType::Status));
     }
-    std::lock_guard lock(wssPingMutex);
-    wssPingCondition.notify_all();
 }
 
 }
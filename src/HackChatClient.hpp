@@ -1,8 +1,17 @@
 #pragma once
-#include <websocketpp/config/asio_client.hpp>
-#include <websocketpp/client.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
 #include <json/json.h>
-#include "JThread.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "HackChatFrame.hpp"
+#include "HackChatSender.hpp"
+#include "HackChatWssConfig.hpp"
+#include "HackChatTls.hpp"
+#include "HackChatCapture.hpp"
+#include "Backoff.hpp"
 #include "HarpoonEventQueue.hpp"
 #include "HackChatEventQueue.hpp"
 #include "globals.hpp"
@@ -10,38 +19,88 @@
 namespace hackchat
 {
 
-using WssClient = websocketpp::client<websocketpp::config::asio_tls_client>;
-using WssMessagePtr = websocketpp::config::asio_client::message_type::ptr;
-using WssErrorCode = websocketpp::lib::error_code;
-
+/// One hack.chat connection. Everything besides the constructor runs on
+/// the client's strand of the shared io_service, so the connection state
+/// needs no locks.
 class Client
 {
 public:
-    explicit Client(EventQueue& harpoon);
-    ~Client();
+    /// capture may be null
+    Client(EventQueue& harpoon, boost::asio::io_service& io, TlsContext& tls, CaptureWriter* capture, uint16_t channelId);
 
     void onHackSendMessage(const EventHackSendMessage& event);
     void onHackConnect(const EventHackConnect& event);
     void onHackConnected(const EventHackConnected& event);
     void onHackDisconnect(const EventHackDisconnect& event);
     void onHackDisconnected(const EventHackDisconnected& event);
+    /// decodes an inbound frame, modifies payload
+    void onFrame(std::string& payload);
+    /// feeds a captured frame through onFrame on the strand, inFlight is decremented once it is handled
+    void replayFrame(std::string payload, std::atomic<size_t>& inFlight);
+
+    void onChat(const Frame& frame);
+    void onInfo(const Frame& frame);
+    void onWhisper(const Frame& frame);
+    void onWarn(const Frame& frame);
+    void onEmote(const Frame& frame);
+    void onInvite(const Frame& frame);
+    void onCaptcha(const Frame& frame);
+    void onOnlineSet(const Frame& frame);
+    void onOnlineAdd(const Frame& frame);
+    void onOnlineRemove(const Frame& frame);
 
+    /// handled on the strand
     HackChatEventQueue queue;
 
 private:
+    static constexpr size_t MaxCommands = 32;
+
+    void handleEvent(HackChatEvent& event);
+    void startConnect();
+    void scheduleReconnect();
+    void onOpen(bool resumed, bool deflate);
+    void schedulePing();
+    void reportStats();
+    /// tags the event with this connection's channel and hands it to harpoon
+    template<class T>
+    inline void publish(T event)
+    {
+        event.channel = channelId;
+        harpoon.push(std::move(event));
+    }
+
     EventQueue& harpoon;
+    TlsContext& tls;
+    CaptureWriter* capture;
+    const uint16_t channelId;
 
     std::string server, channel, username, password;
 
+    InboundParser parser;
+    Frame frame;
+    /// frames received per command, the entry after the last command counts unknown ones
+    std::array<std::atomic<uint64_t>, MaxCommands> frameCounts{};
+
+    boost::asio::io_service::strand strand;
     bool connected;
     WssClient wss;
     websocketpp::connection_hdl wssHandle;
-    NJThread wssThread;
-    NJThread wssPingThread;
-    std::mutex wssPingMutex;
-    std::condition_variable wssPingCondition;
+    Sender sender;
+    boost::asio::steady_timer pingTimer;
+    bool deflate;
+    uint64_t wireBytes;
+    uint64_t decodedBytes;
 
-    NJThread eventHandlerThread;
+    Backoff backoff;
+    boost::asio::steady_timer reconnectTimer;
+    /// set while the connection is lost and being restored
+    bool reconnecting;
+    std::chrono::steady_clock::time_point disconnectedAt;
+    uint64_t reconnects;
+    uint64_t reconnectAttempts;
+    std::chrono::milliseconds lastReconnect;
+    std::chrono::milliseconds totalReconnect;
+    std::chrono::milliseconds maxReconnect;
 };
 
 }
@@ -0,0 +1,112 @@
+#include "HackChatConnectionManager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include "globals.hpp"
+
+namespace hackchat
+{
+
+ConnectionManager::ConnectionManager(EventQueue& harpoon, size_t threadCount)
+    : harpoon(harpoon)
+    , work(std::in_place, io)
+    , replayInFlight(0)
+    , replayStop(false)
+{
+    if (threadCount == 0) threadCount = 1;
+    threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+        threads.emplace_back("WssThread" + std::to_string(i), [this]{ io.run(); });
+}
+ConnectionManager::~ConnectionManager()
+{
+    // nothing drains the frontend's queue anymore, pushes still running must not wait on it
+    harpoon.close();
+    replayStop = true;
+    replayThread.join();
+    work.reset();
+    io.stop();
+    for (auto& thread : threads) thread.join();
+    clients.clear(); // before the io_service their sockets and timers belong to
+}
+
+uint16_t ConnectionManager::connect(const std::string& server,
+                                    const std::string& channel,
+                                    const std::string& username,
+                                    const std::string& password)
+{
+    Client& client = add(channel);
+    client.queue.push(EventHackConnect(server, channel, username, password));
+    return static_cast<uint16_t>(clients.size() - 1);
+}
+
+Client& ConnectionManager::add(const std::string& channel)
+{
+    if (clients.size() > std::numeric_limits<uint16_t>::max())
+        throw std::runtime_error("Too many connections");
+    const uint16_t id = static_cast<uint16_t>(clients.size());
+    channels.push_back(channel);
+    clients.push_back(std::make_unique<Client>(harpoon, io, tls, capture.get(), id));
+    if (capture) capture->channel(id, channel);
+    return *clients.back();
+}
+
+void ConnectionManager::startCapture(const std::string& path)
+{
+    capture = std::make_unique<CaptureWriter>(path);
+}
+
+void ConnectionManager::replay(const std::string& path, bool realtime)
+{
+    replayReader = std::make_unique<CaptureReader>(path, WssConfig::max_message_size);
+    // the channels lead the capture, the frontend needs them up front
+    bool more;
+    while ((more = replayReader->next(replayRecord)) && replayRecord.kind == CaptureKind::Channel)
+        add(replayRecord.payload);
+    if (clients.empty()) throw std::runtime_error("No channels in capture " + path);
+    if (!more) return;
+    replayThread = NJThread("Replay", [this, realtime]{ runReplay(realtime); });
+}
+
+void ConnectionManager::runReplay(bool realtime)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const int64_t firstTime = replayRecord.time;
+    uint64_t frames = 0;
+    try
+    {
+        do
+        {
+            if (replayRecord.kind != CaptureKind::Frame || replayRecord.channel >= clients.size()) continue;
+            if (realtime)
+            {
+                const auto due = start + std::chrono::microseconds(replayRecord.time - firstTime);
+                for (auto now = std::chrono::steady_clock::now(); now < due && !replayStop; now = std::chrono::steady_clock::now())
+                    std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(due - now, std::chrono::milliseconds(100)));
+            }
+            while (replayInFlight.load(std::memory_order_acquire) >= MaxReplayInFlight && !replayStop)
+                std::this_thread::yield();
+            replayInFlight.fetch_add(1, std::memory_order_relaxed);
+            clients[replayRecord.channel]->replayFrame(std::move(replayRecord.payload), replayInFlight);
+            ++frames;
+        }
+        while (!replayStop && RUNNING && replayReader->next(replayRecord));
+    }
+    catch (const std::runtime_error& e)
+    {
+        harpoon.push(EventMessage("system", std::string("replay failed: ") + e.what(), MessageType::Status));
+    }
+
+    while (replayInFlight.load(std::memory_order_acquire) > 0 && !replayStop)
+        std::this_thread::yield();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    char text[128];
+    std::snprintf(text, sizeof(text), "replay finished: %llu frames in %.3fs, %.0f frames/s",
+                  static_cast<unsigned long long>(frames), seconds, seconds > 0 ? frames / seconds : 0.0);
+    harpoon.push(EventMessage("system", text, MessageType::Status));
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include "JThread.hpp"
+#include "HackChatClient.hpp"
+#include "HackChatTls.hpp"
+#include "HackChatCapture.hpp"
+#include "HarpoonEventQueue.hpp"
+
+namespace hackchat
+{
+
+/// Owns all hack.chat connections. They share one io_service which is
+/// run by a fixed number of threads, independent of the connection count.
+/// Events of each connection are tagged with its channel id.
+class ConnectionManager
+{
+public:
+    ConnectionManager(EventQueue& harpoon, size_t threadCount);
+    /// closes harpoon, the frontend draining it has to be gone already
+    ~ConnectionManager();
+    ConnectionManager(const ConnectionManager&) = delete;
+    ConnectionManager& operator=(const ConnectionManager&) = delete;
+
+    /// creates a connection and starts connecting, returns its channel id.
+    /// All connections have to be added before the frontend is created.
+    uint16_t connect(const std::string& server,
+                     const std::string& channel,
+                     const std::string& username,
+                     const std::string& password);
+
+    /// records the inbound frames of all connections added afterwards
+    void startCapture(const std::string& path);
+    /// instead of connecting, creates the channels of a capture and feeds
+    /// its frames through the clients, paced like recorded or as fast as possible
+    void replay(const std::string& path, bool realtime);
+
+    inline size_t size() const { return clients.size(); }
+    inline const std::string& channel(size_t id) const { return channels[id]; }
+    inline HackChatEventQueue& queue(size_t id) { return clients[id]->queue; }
+
+private:
+    /// frames posted by the replay but not handled yet
+    static constexpr size_t MaxReplayInFlight = 1024;
+
+    Client& add(const std::string& channel);
+    void runReplay(bool realtime);
+
+    EventQueue& harpoon;
+    boost::asio::io_service io;
+    std::optional<boost::asio::io_service::work> work;
+    TlsContext tls;
+    std::unique_ptr<CaptureWriter> capture;
+    std::unique_ptr<CaptureReader> replayReader;
+    CaptureRecord replayRecord;
+    std::atomic<size_t> replayInFlight;
+    std::atomic<bool> replayStop;
+    std::vector<std::string> channels;
+    std::vector<std::unique_ptr<Client>> clients;
+    std::vector<NJThread> threads;
+    NJThread replayThread;
+};
+
+}
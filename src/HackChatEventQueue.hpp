@@ -1,11 +1,44 @@
+#pragma once
+#include <functional>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
 #include "EventList.hpp"
+#include "HackChatEvents.hpp"
 
 using HackChatEvent = EventList_t<
-    class EventHackSendMessage,
-    class EventHackConnect,
-    class EventHackDisconnect,
-    class EventHackConnected,
-    class EventHackDisconnected
+    EventHackSendMessage,
+    EventHackConnect,
+    EventHackDisconnect,
+    EventHackConnected,
+    EventHackDisconnected
     >;
 
-using HackChatEventQueue = Queue<HackChatEvent>;
+/// Hands events to a connection by posting them onto its strand,
+/// no thread sits waiting for them.
+class HackChatEventQueue
+{
+public:
+    using Handler = std::function<void(HackChatEvent&)>;
+
+    inline HackChatEventQueue(boost::asio::io_service::strand& strand, Handler handler)
+        : strand(strand)
+        , handler(std::move(handler))
+    {
+    }
+    HackChatEventQueue(const HackChatEventQueue&) = delete;
+    HackChatEventQueue& operator=(const HackChatEventQueue&) = delete;
+
+    /// may be called from any thread
+    inline void push(HackChatEvent&& event)
+    {
+        strand.post(
+            [this, event = std::move(event)]() mutable
+            {
+                handler(event);
+            });
+    }
+
+private:
+    boost::asio::io_service::strand& strand;
+    Handler handler;
+};
@@ -1,9 +1,7 @@
 #pragma once
-#include "Queue.hpp"
 #include <boost/date_time.hpp>
 #include "enums/MessageType.hpp"
 #include "enums/UserChangeType.hpp"
-#include "Queue.hpp"
 
 
 class EventHackSendMessage
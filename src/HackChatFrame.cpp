@@ -0,0 +1,383 @@
+#include "HackChatFrame.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace hackchat
+{
+
+
+void Frame::clear()
+{
+    cmd = nick = text = trip = type = from = utype = channel = inviteChannel = std::string_view();
+    nicks.clear();
+    time = 0;
+    hasTime = false;
+    mod = false;
+}
+
+
+namespace
+{
+
+class Reader
+{
+public:
+    inline Reader(char* begin, char* end) : p(begin), end(end) { }
+
+    inline void skipSpace()
+    {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    }
+
+    inline bool consume(char c)
+    {
+        skipSpace();
+        if (p == end || *p != c) return false;
+        ++p;
+        return true;
+    }
+
+    inline bool peek(char c)
+    {
+        skipSpace();
+        return p != end && *p == c;
+    }
+
+    /// parses a string and unescapes it in place
+    bool string(std::string_view& out)
+    {
+        if (!consume('"')) return false;
+        char* begin = p;
+        while (p != end && *p != '"' && *p != '\\') ++p;
+        if (p == end) return false;
+        if (*p == '"')
+        {
+            out = std::string_view(begin, p - begin);
+            ++p;
+            return true;
+        }
+        char* w = p;
+        while (p != end)
+        {
+            const char c = *p++;
+            if (c == '"')
+            {
+                out = std::string_view(begin, w - begin);
+                return true;
+            }
+            if (c != '\\')
+            {
+                *w++ = c;
+                continue;
+            }
+            if (p == end) return false;
+            switch (*p++)
+            {
+                case '"': *w++ = '"'; break;
+                case '\\': *w++ = '\\'; break;
+                case '/': *w++ = '/'; break;
+                case 'b': *w++ = '\b'; break;
+                case 'f': *w++ = '\f'; break;
+                case 'n': *w++ = '\n'; break;
+                case 'r': *w++ = '\r'; break;
+                case 't': *w++ = '\t'; break;
+                case 'u':
+                {
+                    uint32_t cp;
+                    if (!hex4(cp)) return false;
+                    if (cp >= 0xd800 && cp < 0xdc00)
+                    {
+                        uint32_t low;
+                        if (end - p < 6 || p[0] != '\\' || p[1] != 'u') return false;
+                        p += 2;
+                        if (!hex4(low) || low < 0xdc00 || low >= 0xe000) return false;
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    w = utf8(w, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    /// parses any value, isInteger tells whether it was a number with a
+    /// whole value in the range of out. Numbers are read as leniently as
+    /// jsoncpp reads them, so both parsers take the same frames.
+    bool integer(int64_t& out, bool& isInteger)
+    {
+        isInteger = false;
+        skipSpace();
+        if (p == end || (*p != '-' && (*p < '0' || *p > '9'))) return skipValue();
+        char* begin = p;
+        if (*p == '-') ++p;
+        digits();
+        bool real = false;
+        if (p != end && *p == '.')
+        {
+            ++p;
+            digits();
+            real = true;
+        }
+        if (p != end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            if (p != end && (*p == '+' || *p == '-')) ++p;
+            digits();
+            real = true;
+        }
+        if (!real)
+        {
+            // a lone minus is zero to jsoncpp
+            if (p - begin == 1) out = 0;
+            else if (std::from_chars(begin, p, out).ec != std::errc()) real = true;
+            isInteger = !real;
+            if (isInteger) return true;
+        }
+        // fractions, exponents and integers too long for out are read as double
+        double value;
+        if (std::from_chars(begin, p, value).ec != std::errc()) return false;
+        constexpr double limit = 9223372036854775808.0; // 2^63
+        if (value >= -limit && value < limit && value == std::trunc(value))
+        {
+            out = static_cast<int64_t>(value);
+            isInteger = true;
+        }
+        return true;
+    }
+
+    bool literal(const char* word)
+    {
+        skipSpace();
+        const size_t length = std::strlen(word);
+        if (static_cast<size_t>(end - p) < length || std::memcmp(p, word, length) != 0) return false;
+        p += length;
+        return true;
+    }
+
+    /// a string, anything else is skipped and leaves out empty
+    bool optionalString(std::string_view& out)
+    {
+        if (peek('"')) return string(out);
+        out = std::string_view();
+        return skipValue();
+    }
+
+    bool boolean(bool& out)
+    {
+        if (literal("true")) out = true;
+        else if (literal("false")) out = false;
+        else
+        {
+            out = false;
+            return skipValue();
+        }
+        return true;
+    }
+
+    /// the strings of an array, a repeated key replaces them like in jsoncpp
+    bool stringArray(std::vector<std::string_view>& out)
+    {
+        out.clear();
+        if (!consume('[')) return skipValue();
+        if (consume(']')) return true;
+        do
+        {
+            std::string_view value;
+            if (peek('"'))
+            {
+                if (!string(value)) return false;
+                out.push_back(value);
+            }
+            else if (!skipValue()) return false;
+        }
+        while (consume(','));
+        return consume(']');
+    }
+
+    bool skipValue(int depth = 0)
+    {
+        if (depth > 64) return false;
+        skipSpace();
+        if (p == end) return false;
+        std::string_view ignored;
+        int64_t number;
+        bool isInteger;
+        switch (*p)
+        {
+            case '"':
+                return string(ignored);
+            case '{':
+                ++p;
+                if (consume('}')) return true;
+                do
+                {
+                    if (!string(ignored) || !consume(':') || !skipValue(depth + 1)) return false;
+                }
+                while (consume(','));
+                return consume('}');
+            case '[':
+                ++p;
+                if (consume(']')) return true;
+                do
+                {
+                    if (!skipValue(depth + 1)) return false;
+                }
+                while (consume(','));
+                return consume(']');
+            case 't':
+                return literal("true");
+            case 'f':
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                return (*p == '-' || (*p >= '0' && *p <= '9')) && integer(number, isInteger);
+        }
+    }
+
+private:
+    inline void digits()
+    {
+        while (p != end && *p >= '0' && *p <= '9') ++p;
+    }
+
+    bool hex4(uint32_t& out)
+    {
+        if (end - p < 4) return false;
+        out = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const char c = *p++;
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= c - '0';
+            else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    /// the encoded form is never longer than the escape sequence
+    static char* utf8(char* w, uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            *w++ = static_cast<char>(cp);
+        }
+        else if (cp < 0x800)
+        {
+            *w++ = static_cast<char>(0xc0 | (cp >> 6));
+            *w++ = static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        else if (cp < 0x10000)
+        {
+            *w++ = static_cast<char>(0xe0 | (cp >> 12));
+            *w++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            *w++ = static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        else
+        {
+            *w++ = static_cast<char>(0xf0 | (cp >> 18));
+            *w++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            *w++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            *w++ = static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        return w;
+    }
+
+    char* p;
+    char* end;
+};
+
+}
+
+
+bool FrameParser::parse(std::string& payload, Frame& frame)
+{
+    frame.clear();
+    Reader reader(payload.data(), payload.data() + payload.size());
+    if (!reader.consume('{')) return false;
+    if (reader.consume('}')) return true;
+    do
+    {
+        std::string_view key;
+        if (!reader.string(key) || !reader.consume(':')) return false;
+
+        bool ok;
+        // fields of the wrong type are left empty, like JsonFrameParser does
+        if (key == "cmd") ok = reader.optionalString(frame.cmd);
+        else if (key == "nick") ok = reader.optionalString(frame.nick);
+        else if (key == "text") ok = reader.optionalString(frame.text);
+        else if (key == "trip") ok = reader.optionalString(frame.trip);
+        else if (key == "type") ok = reader.optionalString(frame.type);
+        else if (key == "from") ok = reader.optionalString(frame.from);
+        else if (key == "utype") ok = reader.optionalString(frame.utype);
+        else if (key == "channel") ok = reader.optionalString(frame.channel);
+        else if (key == "inviteChannel") ok = reader.optionalString(frame.inviteChannel);
+        else if (key == "mod") ok = reader.boolean(frame.mod);
+        else if (key == "nicks") ok = reader.stringArray(frame.nicks);
+        else if (key == "time") ok = reader.integer(frame.time, frame.hasTime);
+        else ok = reader.skipValue();
+        if (!ok) return false;
+    }
+    while (reader.consume(','));
+    return reader.consume('}');
+}
+
+
+/// view of a string member, empty if missing
+static std::string_view memberView(const Json::Value& root, const char* key)
+{
+    const char* begin;
+    const char* end;
+    const Json::Value* value = root.find(key, key + std::strlen(key));
+    if (value && value->getString(&begin, &end)) return std::string_view(begin, end - begin);
+    return std::string_view();
+}
+
+JsonFrameParser::JsonFrameParser()
+    : reader(Json::CharReaderBuilder().newCharReader())
+{
+}
+
+bool JsonFrameParser::parse(std::string& payload, Frame& frame)
+{
+    frame.clear();
+    if (!reader->parse(payload.c_str(), payload.c_str()+payload.size(), &root, &err)) return false;
+    if (!root.isObject()) return false;
+
+    frame.cmd = memberView(root, "cmd");
+    frame.nick = memberView(root, "nick");
+    frame.text = memberView(root, "text");
+    frame.trip = memberView(root, "trip");
+    frame.type = memberView(root, "type");
+    frame.from = memberView(root, "from");
+    frame.utype = memberView(root, "utype");
+    frame.channel = memberView(root, "channel");
+    frame.inviteChannel = memberView(root, "inviteChannel");
+    const Json::Value* mod = root.find("mod", "mod" + 3);
+    frame.mod = mod && mod->isBool() && mod->asBool();
+    const Json::Value* time = root.find("time", "time" + 4);
+    if (time && time->isIntegral())
+    {
+        frame.time = time->asInt64();
+        frame.hasTime = true;
+    }
+    const Json::Value* nicks = root.find("nicks", "nicks" + 5);
+    if (nicks && nicks->isArray())
+    {
+        for (const auto& nick : *nicks)
+        {
+            const char* begin;
+            const char* end;
+            if (nick.getString(&begin, &end)) frame.nicks.emplace_back(begin, end - begin);
+        }
+    }
+    return true;
+}
+
+}
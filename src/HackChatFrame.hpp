@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <json/json.h>
+
+namespace hackchat
+{
+
+/// The fields of an inbound frame that the client handles.
+/// All views point into the parsed payload.
+struct Frame
+{
+    void clear();
+
+    std::string_view cmd;
+    std::string_view nick;
+    std::string_view text;
+    std::string_view trip;
+    std::string_view type;
+    std::string_view from;
+    std::string_view utype;
+    std::string_view channel;
+    std::string_view inviteChannel;
+    std::vector<std::string_view> nicks;
+    int64_t time;
+    bool hasTime;
+    bool mod;
+};
+
+/// Decodes a frame in one pass without building a DOM.
+/// Escaped strings are unescaped in place, so the payload is modified.
+class FrameParser
+{
+public:
+    bool parse(std::string& payload, Frame& frame);
+};
+
+/// jsoncpp based decoder, kept for comparison (USE_JSONCPP_PARSER).
+class JsonFrameParser
+{
+public:
+    JsonFrameParser();
+
+    bool parse(std::string& payload, Frame& frame);
+
+private:
+    std::unique_ptr<Json::CharReader> reader;
+    Json::Value root;
+    JSONCPP_STRING err;
+};
+
+#ifdef USE_JSONCPP_PARSER
+using InboundParser = JsonFrameParser;
+#else
+using InboundParser = FrameParser;
+#endif
+
+}
@@ -0,0 +1,192 @@
+#include "HackChatSender.hpp"
+#include <cstdio>
+#include "JsonEscape.hpp"
+
+namespace hackchat
+{
+
+namespace
+{
+
+constexpr std::string_view chatPrefix = R"({"cmd":"chat","text":")";
+constexpr std::string_view joinPrefix = R"({"cmd":"join","channel":")";
+constexpr std::string_view joinNick = R"(","nick":")";
+constexpr std::string_view suffix = R"("})";
+constexpr std::string_view pingFrame = R"({"cmd":"ping"})";
+
+/// a chat line waiting longer than this is reported
+constexpr std::chrono::milliseconds reportDelay(500);
+
+}
+
+
+Sender::Sender(WssClient& wss, boost::asio::io_service::strand& strand, EventQueue& harpoon, uint16_t channelId)
+    : wss(wss)
+    , strand(strand)
+    , harpoon(harpoon)
+    , channelId(channelId)
+    , isOpen(false)
+    , bucket(BucketCapacity, BucketRefillPerSecond)
+    , timer(strand.context())
+    , timerArmed(false)
+    , sentControl(0)
+    , sentChat(0)
+    , delayedChat(0)
+    , coalescedChat(0)
+    , totalDelayMs(0)
+    , maxDelayMs(0)
+{
+}
+
+void Sender::open(websocketpp::connection_hdl hdl)
+{
+    strand.post(
+        [this, hdl]
+        {
+            this->hdl = hdl;
+            isOpen = true;
+            flush();
+        });
+}
+
+void Sender::close()
+{
+    strand.post(
+        [this]
+        {
+            isOpen = false;
+            hdl.reset();
+            control.clear(); // join and ping are sent again on the next connection
+        });
+}
+
+void Sender::sendJoin(const std::string& channel, const std::string& nick)
+{
+    std::string frame(joinPrefix);
+    appendJsonEscaped(frame, channel);
+    frame += joinNick;
+    appendJsonEscaped(frame, nick);
+    frame += suffix;
+    strand.post(
+        [this, frame = std::move(frame)]() mutable
+        {
+            control.push_back(std::move(frame));
+            flush();
+        });
+}
+
+void Sender::sendPing()
+{
+    strand.post(
+        [this]
+        {
+            control.emplace_back(pingFrame);
+            flush();
+        });
+}
+
+void Sender::sendChat(std::string text)
+{
+    // the bucket never holds more than its capacity, such a line would wait forever
+    if (chatCost(text) > BucketCapacity)
+    {
+        notify("message not sent, longer than " + std::to_string(MaxChatLength) + " bytes");
+        return;
+    }
+    strand.post(
+        [this, text = std::move(text), queued = Clock::now()]() mutable
+        {
+            chat.push_back(Pending{std::move(text), queued});
+            flush();
+        });
+}
+
+void Sender::flush()
+{
+    if (!isOpen) return;
+    const Clock::time_point now = Clock::now();
+    while (!control.empty())
+    {
+        bucket.force(ControlCost, now);
+        write(control.front());
+        control.pop_front();
+        sentControl.fetch_add(1, std::memory_order_relaxed);
+    }
+    while (!chat.empty())
+    {
+        Pending& pending = chat.front();
+        // lines that piled up behind the limiter go out as one multi line message
+        while (chat.size() > 1 && pending.text.size() + 1 + chat[1].text.size() <= CoalesceLimit)
+        {
+            pending.text += '\n';
+            pending.text += chat[1].text;
+            chat.erase(chat.begin() + 1);
+            coalescedChat.fetch_add(1, std::memory_order_relaxed);
+        }
+        const double cost = chatCost(pending.text);
+        if (!bucket.tryTake(cost, now))
+        {
+            if (!timerArmed)
+            {
+                timerArmed = true;
+                timer.expires_after(bucket.wait(cost, now));
+                timer.async_wait(strand.wrap(
+                    [this](const boost::system::error_code& ec)
+                    {
+                        timerArmed = false;
+                        if (!ec) flush();
+                    }));
+            }
+            return;
+        }
+
+        buffer.assign(chatPrefix);
+        appendJsonEscaped(buffer, pending.text);
+        buffer += suffix;
+        write(buffer);
+
+        const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(now - pending.queued);
+        const uint64_t delayMs = static_cast<uint64_t>(delay.count());
+        sentChat.fetch_add(1, std::memory_order_relaxed);
+        totalDelayMs.fetch_add(delayMs, std::memory_order_relaxed);
+        if (delayMs > maxDelayMs.load(std::memory_order_relaxed)) maxDelayMs.store(delayMs, std::memory_order_relaxed);
+        if (delay >= reportDelay)
+        {
+            delayedChat.fetch_add(1, std::memory_order_relaxed);
+            notify("message held back " + std::to_string(delayMs) + "ms by the rate limit");
+        }
+        chat.pop_front();
+    }
+}
+
+void Sender::write(std::string_view frame)
+{
+    WssErrorCode ec;
+    wss.send(hdl, frame.data(), frame.size(), websocketpp::frame::opcode::text, ec);
+    if (ec) notify("failed to send message to hack.chat: " + ec.message());
+}
+
+void Sender::notify(std::string text)
+{
+    EventMessage event("system", std::move(text), MessageType::Status);
+    event.channel = channelId;
+    harpoon.push(std::move(event));
+}
+
+std::string Sender::describeStats() const
+{
+    const uint64_t chats = sentChat.load(std::memory_order_relaxed);
+    const uint64_t total = totalDelayMs.load(std::memory_order_relaxed);
+    char line[160];
+    std::snprintf(line, sizeof(line),
+                  "send: control=%llu chat=%llu coalesced=%llu delayed=%llu avg-delay=%llums max-delay=%llums",
+                  static_cast<unsigned long long>(sentControl.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(chats),
+                  static_cast<unsigned long long>(coalescedChat.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(delayedChat.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(chats ? total / chats : 0),
+                  static_cast<unsigned long long>(maxDelayMs.load(std::memory_order_relaxed)));
+    return line;
+}
+
+}
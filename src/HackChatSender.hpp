@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include "HackChatWssConfig.hpp"
+#include "HarpoonEventQueue.hpp"
+#include "TokenBucket.hpp"
+
+namespace hackchat
+{
+
+/// Outbound frames of one connection.
+/// Frames are serialized from fixed templates into a reused buffer and
+/// written on the connection's strand. Control frames (join, ping) always
+/// go first, chat lines wait for the token bucket so the server never
+/// kicks us for flooding. Lines queued behind each other are coalesced
+/// into one frame.
+class Sender
+{
+public:
+    using Clock = TokenBucket::Clock;
+
+    Sender(WssClient& wss, boost::asio::io_service::strand& strand, EventQueue& harpoon, uint16_t channelId);
+
+    /// all of these may be called from any thread
+    void open(websocketpp::connection_hdl hdl);
+    void close();
+    void sendJoin(const std::string& channel, const std::string& nick);
+    void sendPing();
+    void sendChat(std::string text);
+
+    std::string describeStats() const;
+
+private:
+    struct Pending
+    {
+        std::string text;
+        Clock::time_point queued;
+    };
+
+    void flush();
+    void write(std::string_view frame);
+    void notify(std::string text);
+
+    /// hack.chat scores each frame with 1 and chat text with 1 per 332 bytes.
+    /// The server kicks at a score of 25 that halves every 30s, the bucket
+    /// stays below that for bursts and for the sustained rate.
+    static constexpr double BucketCapacity = 20.0;
+    static constexpr double BucketRefillPerSecond = 0.5;
+    static constexpr double ControlCost = 1.0;
+    static constexpr size_t CoalesceLimit = 2048;
+    static inline double chatCost(const std::string& text) { return 1.0 + text.size() / 332.0; }
+    /// longest line whose cost fits into the bucket at all
+    static constexpr size_t MaxChatLength = static_cast<size_t>((BucketCapacity - 1.0) * 332.0);
+
+    WssClient& wss;
+    boost::asio::io_service::strand& strand;
+    EventQueue& harpoon;
+    uint16_t channelId;
+
+    // only used on the strand
+    websocketpp::connection_hdl hdl;
+    bool isOpen;
+    TokenBucket bucket;
+    std::deque<std::string> control;
+    std::deque<Pending> chat;
+    std::string buffer;
+    boost::asio::steady_timer timer;
+    bool timerArmed;
+
+    std::atomic<uint64_t> sentControl;
+    std::atomic<uint64_t> sentChat;
+    std::atomic<uint64_t> delayedChat;
+    std::atomic<uint64_t> coalescedChat;
+    std::atomic<uint64_t> totalDelayMs;
+    std::atomic<uint64_t> maxDelayMs;
+};
+
+}
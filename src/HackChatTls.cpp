@@ -0,0 +1,77 @@
+#include "HackChatTls.hpp"
+
+namespace hackchat
+{
+
+namespace
+{
+
+/// ex_data slot pointing from the SSL_CTX back to its TlsContext
+int contextIndex()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+}
+
+
+TlsContext::TlsContext()
+    : ctx(std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls))
+    , resumed(0)
+    , full(0)
+{
+    ctx->set_options(boost::asio::ssl::context::default_workarounds |
+                     boost::asio::ssl::context::no_sslv2 |
+                     boost::asio::ssl::context::no_sslv3 |
+                     boost::asio::ssl::context::single_dh_use);
+
+    SSL_CTX* native = ctx->native_handle();
+    SSL_CTX_set_ex_data(native, contextIndex(), this);
+    // the internal store is keyed by session id, lookups by host happen here
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, &TlsContext::onNewSession);
+}
+TlsContext::~TlsContext()
+{
+    SSL_CTX_sess_set_new_cb(ctx->native_handle(), nullptr);
+    for (auto& entry : sessions) SSL_SESSION_free(entry.second);
+}
+
+void TlsContext::prepare(SSL* ssl, const std::string& host)
+{
+    SSL_set_tlsext_host_name(ssl, host.c_str());
+    std::lock_guard lock(sessionsMutex);
+    auto it = sessions.find(host);
+    if (it != sessions.end()) SSL_set_session(ssl, it->second);
+}
+
+bool TlsContext::finished(SSL* ssl)
+{
+    const bool reused = SSL_session_reused(ssl) == 1;
+    (reused ? resumed : full).fetch_add(1, std::memory_order_relaxed);
+    return reused;
+}
+
+int TlsContext::onNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!host) return 0;
+    // keep a copy, OpenSSL marks the original not resumable if the
+    // connection drops without a close_notify, which is the case we are after
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (!copy) return 0;
+    auto* self = static_cast<TlsContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+    self->store(host, copy);
+    return 0;
+}
+
+void TlsContext::store(const std::string& host, SSL_SESSION* session)
+{
+    std::lock_guard lock(sessionsMutex);
+    SSL_SESSION*& slot = sessions[host];
+    if (slot) SSL_SESSION_free(slot);
+    slot = session;
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <boost/asio/ssl/context.hpp>
+#include <openssl/ssl.h>
+
+namespace hackchat
+{
+
+/// TLS context shared by all connections.
+/// Sessions the server hands out are kept per host name, a reconnect
+/// offers the last one and can skip the full handshake.
+class TlsContext
+{
+public:
+    TlsContext();
+    ~TlsContext();
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    inline const std::shared_ptr<boost::asio::ssl::context>& context() const { return ctx; }
+
+    /// to be called from the socket init handler, before the handshake
+    void prepare(SSL* ssl, const std::string& host);
+    /// to be called once the handshake is done, returns whether the session was resumed
+    bool finished(SSL* ssl);
+
+    inline uint64_t resumedCount() const { return resumed.load(std::memory_order_relaxed); }
+    inline uint64_t fullCount() const { return full.load(std::memory_order_relaxed); }
+
+private:
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    void store(const std::string& host, SSL_SESSION* session);
+
+    std::shared_ptr<boost::asio::ssl::context> ctx;
+    std::mutex sessionsMutex;
+    std::map<std::string, SSL_SESSION*> sessions;
+    std::atomic<uint64_t> resumed;
+    std::atomic<uint64_t> full;
+};
+
+}
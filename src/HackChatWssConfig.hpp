@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/client.hpp>
+
+namespace hackchat
+{
+
+/// permessage-deflate which counts the compressed input of each message.
+/// The extension belongs to a single connection, whose frames may be
+/// inflated on any thread running the shared io_service but never two at
+/// once. websocketpp calls the message handler right after inflating the
+/// last frame, on the same thread, so lastInflated still points at the
+/// count of the connection the message came from.
+template<class Config>
+class CountingDeflate : public websocketpp::extensions::permessage_deflate::enabled<Config>
+{
+    using Base = websocketpp::extensions::permessage_deflate::enabled<Config>;
+
+public:
+    inline websocketpp::lib::error_code decompress(uint8_t const* buf, size_t len, std::string& out)
+    {
+        inflated += len;
+        lastInflated() = &inflated;
+        return Base::decompress(buf, len, out);
+    }
+
+    /// compressed bytes of the message just completed on this thread,
+    /// only to be called from the message handler of a compressed message
+    static inline size_t take()
+    {
+        size_t* const count = std::exchange(lastInflated(), nullptr);
+        return count ? std::exchange(*count, 0) : 0;
+    }
+
+private:
+    static inline size_t*& lastInflated()
+    {
+        thread_local size_t* count = nullptr;
+        return count;
+    }
+
+    /// since the last message taken
+    size_t inflated = 0;
+};
+
+/// Per connection message manager that hands out messages again once
+/// nobody else holds them, so frame payloads keep their capacity instead
+/// of being allocated per frame.
+template<class Message>
+class RecyclingMessageManager : public websocketpp::lib::enable_shared_from_this<RecyclingMessageManager<Message>>
+{
+public:
+    using type = RecyclingMessageManager<Message>;
+    using ptr = websocketpp::lib::shared_ptr<type>;
+    using weak_ptr = websocketpp::lib::weak_ptr<type>;
+    using message_ptr = typename Message::ptr;
+
+    inline message_ptr get_message()
+    {
+        return websocketpp::lib::make_shared<Message>(this->shared_from_this());
+    }
+
+    inline message_ptr get_message(websocketpp::frame::opcode::value op, size_t size)
+    {
+        // the reader and senders on other threads share the manager
+        std::lock_guard lock(mutex);
+        for (const message_ptr& message : pool)
+        {
+            if (message.use_count() != 1) continue;
+            std::atomic_thread_fence(std::memory_order_acquire); // see the last owner's writes
+            message->set_opcode(op);
+            message->set_fin(true);
+            message->set_prepared(false);
+            message->set_terminal(false);
+            message->set_compressed(false);
+            message->set_header(std::string());
+            message->get_raw_payload().clear();
+            message->get_raw_payload().reserve(size);
+            return message;
+        }
+        message_ptr message = websocketpp::lib::make_shared<Message>(this->shared_from_this(), op, size);
+        if (pool.size() < PoolSize) pool.push_back(message);
+        return message;
+    }
+
+    inline bool recycle(Message*)
+    {
+        return false;
+    }
+
+private:
+    static constexpr size_t PoolSize = 8;
+
+    std::mutex mutex;
+    std::vector<message_ptr> pool;
+};
+
+/// asio_tls_client with permessage-deflate and recycled messages
+struct WssConfig : public websocketpp::config::asio_tls_client
+{
+    using type = WssConfig;
+    using base = websocketpp::config::asio_tls_client;
+
+    using message_type = websocketpp::message_buffer::message<RecyclingMessageManager>;
+    using con_msg_manager_type = RecyclingMessageManager<message_type>;
+    using endpoint_msg_manager_type = websocketpp::message_buffer::alloc::endpoint_msg_manager<con_msg_manager_type>;
+
+    struct permessage_deflate_config
+    {
+        using request_type = base::request_type;
+    };
+    using permessage_deflate_type = CountingDeflate<permessage_deflate_config>;
+};
+
+using WssClient = websocketpp::client<WssConfig>;
+using WssMessagePtr = WssConfig::message_type::ptr;
+using WssErrorCode = websocketpp::lib::error_code;
+
+}
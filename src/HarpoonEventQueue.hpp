@@ -1,12 +1,21 @@
 #pragma once
 #include "EventList.hpp"
-#include "Queue.hpp"
+#include "ObjectPool.hpp"
+#include "RingQueue.hpp"
+#include "HarpoonEvents.hpp"
 
 using Event = EventList_t<
-    class EventInput,
-    class EventUserList,
-    class EventUserChanged,
-    class EventMessage
+    EventInput,
+    EventUserList,
+    EventUserChanged,
+    EventMessage
     >;
 
-using EventQueue = Queue<Event>;
+class EventQueue : public RingQueue<Event, 4096>
+{
+public:
+    /// payloads handed back by the consumer for the producers to refill,
+    /// room for all the queue and a drained batch hold and then some, so
+    /// none is dropped only to be allocated again
+    ObjectPool<EventMessage> messages{3 * 4096};
+};
@@ -1,17 +1,19 @@
 #pragma once
-#include "Queue.hpp"
-#include <boost/date_time.hpp>
-#include <variant>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "InlineString.hpp"
+#include "InternedString.hpp"
 #include "enums/MessageType.hpp"
 #include "enums/UserChangeType.hpp"
-#include "Queue.hpp"
 
 
 class EventInput
 {
 public:
     inline EventInput(const std::string& message) : message(message) {}
-    inline virtual ~EventInput() = default;
 
     std::string message;
 };
@@ -19,7 +21,7 @@ class EventUserList
 {
 public:
     inline EventUserList(std::vector<std::string>&& users)
-        : users(users)
+        : users(std::move(users))
     {
     }
     inline EventUserList(const std::vector<std::string>& users)
@@ -28,12 +30,13 @@ public:
     }
 
     std::vector<std::string> users;
+    uint16_t channel = 0;
 };
 class EventUserChanged
 {
 public:
     inline EventUserChanged(std::string&& user, UserChangeType changeType)
-        : user(user)
+        : user(std::move(user))
         , changeType(changeType)
     {
     }
@@ -45,23 +48,58 @@ public:
 
     std::string user;
     UserChangeType changeType;
+    uint16_t channel = 0;
 };
 class EventMessage
 {
 public:
-    inline EventMessage(const std::string& sender,
-                        const std::string& message,
+    struct Flags
+    {
+        bool mod : 1;
+        bool me : 1;
+        bool whisper : 1;
+        bool status : 1;
+        /// names the own nick or a highlight word, set on ingest
+        bool mention : 1;
+    };
+
+    inline EventMessage()
+        : time(currentTime())
+        , flags()
+        , channel(0)
+    {
+    }
+    inline EventMessage(std::string_view sender,
+                        std::string message,
                         MessageType type = MessageType::Normal)
-        : time(boost::posix_time::second_clock::universal_time())
+        : time(currentTime())
         , sender(sender)
-        , message(message)
-        , type(type)
+        , message(std::move(message))
+        , flags(flagsFor(type))
+        , channel(0)
+    {
+    }
+
+    /// milliseconds since the epoch, UTC
+    static inline int64_t currentTime()
+    {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+    static inline Flags flagsFor(MessageType type)
     {
+        Flags flags{};
+        flags.me = type == MessageType::Me;
+        flags.whisper = type == MessageType::Whisper;
+        flags.status = type == MessageType::Status;
+        return flags;
     }
 
-    boost::posix_time::ptime time;
-    std::string sender;
+    int64_t time;
+    InternedString sender;
     std::string message;
-    MessageType type;
-    std::map<std::string, std::string> extra;
+    InlineString<7> trip;
+    Flags flags;
+    /// id of the connection, fits into the padding
+    uint16_t channel;
 };
@@ -0,0 +1,208 @@
+#include "HeadlessFrontend.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "JsonEscape.hpp"
+#include "globals.hpp"
+
+namespace
+{
+
+template<class T>
+void put(std::string& out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out += static_cast<char>(static_cast<uint64_t>(value) >> (8 * i) & 0xff);
+}
+
+}
+
+
+HeadlessFrontend::HeadlessFrontend(EventQueue& queue,
+                                   hackchat::ConnectionManager& connections,
+                                   SimpleSignalHandler& signalHandler,
+                                   const std::string& path,
+                                   Format format)
+    : queue(queue)
+    , connections(connections)
+    , signalHandler(signalHandler)
+    , format(format)
+    , fd(STDOUT_FILENO)
+    , ownsFd(false)
+    , events(0)
+    , bytes(0)
+    , writes(0)
+{
+    if (path != "-")
+    {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::runtime_error("Failed to open output file " + path);
+        ownsFd = true;
+    }
+    buffer.reserve(FlushSize * 2);
+    t = NJThread("Headless", [this]{ run(); });
+}
+HeadlessFrontend::~HeadlessFrontend()
+{
+    RUNNING = false;
+    queue.interrupt();
+    t.join();
+    if (ownsFd) close(fd);
+}
+
+void HeadlessFrontend::join()
+{
+    t.join();
+}
+
+void HeadlessFrontend::run()
+{
+    std::vector<Event> batch;
+    pollfd fds[2] = {
+        {queue.fd(), POLLIN, 0},
+        {signalHandler.fd(), POLLIN, 0}};
+    while (RUNNING)
+    {
+        while (signalHandler.next()) { }
+        if (!RUNNING) break;
+
+        if (queue.tryDrain(batch) > 0)
+        {
+            for (auto& event : batch) dispatch(event);
+            events += batch.size();
+            batch.clear();
+            if (buffer.size() >= FlushSize) flush();
+            continue; // keep batching while events arrive
+        }
+        flush();
+        if (queue.prepareWait())
+        {
+            poll(fds, 2, -1);
+            queue.finishWait();
+        }
+    }
+    queue.tryDrain(batch);
+    for (auto& event : batch) dispatch(event);
+    flush();
+}
+
+void HeadlessFrontend::flush()
+{
+    size_t written = 0;
+    while (written < buffer.size())
+    {
+        const ssize_t res = write(fd, buffer.data() + written, buffer.size() - written);
+        if (res < 0)
+        {
+            if (errno == EINTR) continue;
+            RUNNING = false; // output is gone, e.g. a closed pipe
+            break;
+        }
+        written += res;
+    }
+    if (written > 0) ++writes;
+    bytes += written;
+    buffer.clear();
+}
+
+void HeadlessFrontend::beginRecord(const char* type, uint8_t binaryType, uint16_t channel, int64_t time)
+{
+    if (format == Format::Binary)
+    {
+        put<uint8_t>(buffer, binaryType);
+        put<uint16_t>(buffer, channel);
+        put<int64_t>(buffer, time);
+        return;
+    }
+    buffer += "{\"type\":\"";
+    buffer += type;
+    buffer += "\",\"time\":";
+    buffer += std::to_string(time);
+    appendString("channel", channel < connections.size() ? connections.channel(channel) : std::string());
+}
+
+void HeadlessFrontend::appendString(const char* key, std::string_view value)
+{
+    if (format == Format::Binary)
+    {
+        put<uint32_t>(buffer, static_cast<uint32_t>(value.size()));
+        buffer.append(value.data(), value.size());
+        return;
+    }
+    buffer += ",\"";
+    buffer += key;
+    buffer += "\":\"";
+    appendJsonEscaped(buffer, value);
+    buffer += '"';
+}
+
+void HeadlessFrontend::onInput(const EventInput& event)
+{
+    if (connections.size() > 0) connections.queue(0).push(EventHackSendMessage(event.message));
+}
+
+void HeadlessFrontend::onUserList(EventUserList&& event)
+{
+    beginRecord("users", 2, event.channel, EventMessage::currentTime());
+    if (format == Format::Binary)
+    {
+        put<uint32_t>(buffer, static_cast<uint32_t>(event.users.size()));
+        for (const auto& user : event.users) appendString(nullptr, user);
+        return;
+    }
+    buffer += ",\"users\":[";
+    for (size_t i = 0; i < event.users.size(); ++i)
+    {
+        if (i) buffer += ',';
+        buffer += '"';
+        appendJsonEscaped(buffer, event.users[i]);
+        buffer += '"';
+    }
+    buffer += "]}\n";
+}
+
+void HeadlessFrontend::onUserChanged(const EventUserChanged& event)
+{
+    const bool added = event.changeType == UserChangeType::Add;
+    beginRecord(added ? "join" : "leave", added ? 3 : 4, event.channel, EventMessage::currentTime());
+    appendString("nick", event.user);
+    if (format == Format::NdJson) buffer += "}\n";
+}
+
+void HeadlessFrontend::onMessage(EventMessage&& event)
+{
+    const EventMessage::Flags flags = event.flags;
+    beginRecord("message", 1, event.channel, event.time);
+    if (format == Format::Binary)
+    {
+        put<uint8_t>(buffer, flags.mod | flags.me << 1 | flags.whisper << 2 | flags.status << 3);
+        appendString(nullptr, event.sender.view());
+        appendString(nullptr, event.trip.view());
+        appendString(nullptr, event.message);
+    }
+    else
+    {
+        appendString("nick", event.sender.view());
+        if (!event.trip.empty()) appendString("trip", event.trip.view());
+        appendString("text", event.message);
+        if (flags.mod) buffer += ",\"mod\":true";
+        if (flags.me) buffer += ",\"me\":true";
+        if (flags.whisper) buffer += ",\"whisper\":true";
+        if (flags.status) buffer += ",\"status\":true";
+        buffer += "}\n";
+    }
+    queue.messages.release(std::move(event));
+}
+
+std::string HeadlessFrontend::describeStats() const
+{
+    char line[128];
+    std::snprintf(line, sizeof(line), "headless: events=%llu bytes=%llu writes=%llu",
+                  static_cast<unsigned long long>(events),
+                  static_cast<unsigned long long>(bytes),
+                  static_cast<unsigned long long>(writes));
+    return line;
+}
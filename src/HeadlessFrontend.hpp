@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Frontend.hpp"
+#include "HackChatConnectionManager.hpp"
+#include "HarpoonEventQueue.hpp"
+#include "JThread.hpp"
+#include "SimpleSignalHandler.hpp"
+
+/// Streams all events to a file or stdout instead of a terminal.
+///
+/// ndjson: one object per line with a "type" of message, users, join or leave.
+/// binary: records of u8 type, u16 channel, i64 time (ms), then per type
+///   message (1): u8 flags (mod, me, whisper, status from bit 0), sender, trip, text
+///   users (2):   u32 count, nicks
+///   join (3), leave (4): nick
+/// where every string is a u32 length and its bytes, integers little endian.
+class HeadlessFrontend : public Frontend
+{
+public:
+    enum class Format
+    {
+        NdJson,
+        Binary,
+    };
+
+    /// path "-" writes to stdout
+    HeadlessFrontend(EventQueue& queue,
+                     hackchat::ConnectionManager& connections,
+                     SimpleSignalHandler& signalHandler,
+                     const std::string& path,
+                     Format format);
+    ~HeadlessFrontend() override;
+
+    void join() override;
+    std::string describeStats() const override;
+
+    void onInput(const EventInput&) override;
+    void onUserList(EventUserList&&) override;
+    void onUserChanged(const EventUserChanged&) override;
+    void onMessage(EventMessage&&) override;
+
+private:
+    static constexpr size_t FlushSize = 64 * 1024;
+
+    void run();
+    void flush();
+    void beginRecord(const char* type, uint8_t binaryType, uint16_t channel, int64_t time);
+    void appendString(const char* key, std::string_view value);
+
+    EventQueue& queue;
+    hackchat::ConnectionManager& connections;
+    SimpleSignalHandler& signalHandler;
+    Format format;
+    int fd;
+    bool ownsFd;
+    std::string buffer;
+    uint64_t events;
+    uint64_t bytes;
+    uint64_t writes;
+    NJThread t;
+};
@@ -0,0 +1,434 @@
+#include "History.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr char logMagic[4] = {'H', 'L', 'O', 'G'};
+constexpr char indexMagic[4] = {'H', 'I', 'D', 'X'};
+constexpr uint32_t version = 2;
+/// length, time, flags, sender and trip length
+constexpr size_t recordHeaderSize = 4 + 8 + 1 + 1 + 1;
+
+template<class T>
+void put(std::string& out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out += static_cast<char>(static_cast<uint64_t>(value) >> (8 * i) & 0xff);
+}
+
+template<class T>
+T get(const char* in)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return static_cast<T>(value);
+}
+
+/// channel names may hold anything, keep them a single file name
+std::string fileName(std::string_view channel)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string name;
+    for (char c : channel)
+    {
+        const unsigned char u = static_cast<unsigned char>(c);
+        if ((u >= '0' && u <= '9') || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z')
+            || u == '_' || u == '-' || (u == '.' && !name.empty()))
+        {
+            name += c;
+        }
+        else
+        {
+            name += '%';
+            name += hex[u >> 4];
+            name += hex[u & 15];
+        }
+    }
+    return name;
+}
+
+int openFile(const std::string& path, const char (&magic)[4])
+{
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) throw std::runtime_error("Failed to open history file " + path);
+    // held until the fd is closed, a second writer would interleave records
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("History file " + path + " is in use, is another instance using the same history directory?");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size == 0)
+    {
+        std::string header(magic, sizeof(magic));
+        put<uint32_t>(header, version);
+        if (::write(fd, header.data(), header.size()) == static_cast<ssize_t>(header.size())) return fd;
+    }
+    else
+    {
+        char header[8];
+        if (::pread(fd, header, sizeof(header), 0) == sizeof(header)
+            && std::memcmp(header, magic, sizeof(magic)) == 0
+            && get<uint32_t>(header + sizeof(magic)) == version)
+            return fd;
+    }
+    ::close(fd);
+    throw std::runtime_error("Not a history file of this version: " + path);
+}
+
+/// replaces view with a read only one of the first size bytes when that is more
+void mapFile(int fd, size_t size, const char*& view, size_t& mapped)
+{
+    if (size <= mapped) return;
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) return; // reading stops at the old end
+    if (view) ::munmap(const_cast<char*>(view), mapped);
+    view = static_cast<const char*>(data);
+    mapped = size;
+}
+
+/// size of the complete record at offset, 0 if it is torn
+size_t recordSize(const char* data, size_t size, uint64_t offset)
+{
+    if (size - offset < recordHeaderSize) return 0;
+    const size_t length = get<uint32_t>(data + offset);
+    const size_t names = get<uint8_t>(data + offset + 13) + get<uint8_t>(data + offset + 14);
+    if (length < recordHeaderSize - 4 + names || size - offset - 4 < length) return 0;
+    return 4 + length;
+}
+
+EventMessage decode(const char* record)
+{
+    const size_t length = get<uint32_t>(record);
+    const size_t senderLength = get<uint8_t>(record + 13);
+    const size_t tripLength = get<uint8_t>(record + 14);
+    const char* sender = record + recordHeaderSize;
+    const char* text = sender + senderLength + tripLength;
+    EventMessage message(std::string_view(sender, senderLength),
+                         std::string(text, record + 4 + length - text));
+    message.time = get<int64_t>(record + 4);
+    const uint8_t flags = get<uint8_t>(record + 12);
+    message.flags.mod = flags & 1;
+    message.flags.me = flags >> 1 & 1;
+    message.flags.whisper = flags >> 2 & 1;
+    message.flags.status = flags >> 3 & 1;
+    message.flags.mention = flags >> 4 & 1;
+    message.trip.assign(std::string_view(sender + senderLength, tripLength));
+    return message;
+}
+
+}
+
+
+HistoryLog::HistoryLog(const std::string& directory, std::string_view channel)
+    : path(directory + "/" + fileName(channel))
+    , logFd(-1)
+    , indexFd(-1)
+    , logSize(0)
+    , indexSize(0)
+    , sinceEntry(0)
+    , writtenLog(0)
+    , writtenIndex(0)
+    , mappedLog(nullptr)
+    , mappedLogSize(0)
+    , mappedIndex(nullptr)
+    , mappedIndexSize(0)
+    , loadedFrom(0)
+    , forgotten(0)
+    , lastLoaded()
+    , lastLoadedEnd(0)
+{
+    logFd = openFile(path + ".hlog", logMagic);
+    try
+    {
+        indexFd = openFile(path + ".hidx", indexMagic);
+        recover();
+    }
+    catch (const std::runtime_error&)
+    {
+        ::close(logFd);
+        if (indexFd >= 0) ::close(indexFd);
+        throw;
+    }
+    writtenLog = logSize;
+    writtenIndex = indexSize;
+    remap();
+    loadedFrom = mappedLogSize;
+}
+
+HistoryLog::~HistoryLog()
+{
+    if (mappedLog) ::munmap(const_cast<char*>(mappedLog), mappedLogSize);
+    if (mappedIndex) ::munmap(const_cast<char*>(mappedIndex), mappedIndexSize);
+    ::close(logFd);
+    ::close(indexFd);
+}
+
+void HistoryLog::encode(const EventMessage& message, std::string& out)
+{
+    const std::string_view sender = message.sender.view().substr(0, 255);
+    const std::string_view trip = message.trip.view().substr(0, 255);
+    const EventMessage::Flags flags = message.flags;
+    put<uint32_t>(out, recordHeaderSize - 4 + sender.size() + trip.size() + message.message.size());
+    put<int64_t>(out, message.time);
+    put<uint8_t>(out, flags.mod | flags.me << 1 | flags.whisper << 2 | flags.status << 3 | flags.mention << 4);
+    put<uint8_t>(out, sender.size());
+    put<uint8_t>(out, trip.size());
+    out.append(sender.data(), sender.size());
+    out.append(trip.data(), trip.size());
+    out += message.message;
+}
+
+void HistoryLog::write(std::string_view records)
+{
+    if (::pwrite(logFd, records.data(), records.size(), logSize) != static_cast<ssize_t>(records.size()))
+        return; // the next write goes to the same offset again
+    for (size_t offset = 0; offset < records.size(); offset += 4 + get<uint32_t>(records.data() + offset))
+    {
+        if (sinceEntry == 0) appendEntry(logSize + offset);
+        sinceEntry = (sinceEntry + 1) % IndexStride;
+    }
+    logSize += records.size();
+    // the index first, a mapped record is always indexed
+    writtenIndex.store(indexSize, std::memory_order_release);
+    writtenLog.store(logSize, std::memory_order_release);
+}
+
+bool HistoryLog::loadOlder(size_t count, std::vector<EventMessage>& messages)
+{
+    lastLoaded.clear();
+    if (!skipForgotten()) return true; // nothing yet, but there is more
+    lastLoadedEnd = loadedFrom;
+    recordsBefore(loadedFrom, count, lastLoaded);
+    for (uint64_t offset : lastLoaded)
+        messages.push_back(decode(mappedLog + offset));
+    return !lastLoaded.empty();
+}
+
+bool HistoryLog::readOlder(uint64_t& from, size_t count, std::vector<EventMessage>& messages) const
+{
+    std::vector<uint64_t> starts;
+    recordsBefore(from, count, starts);
+    for (uint64_t offset : starts)
+        messages.push_back(decode(mappedLog + offset));
+    return !starts.empty();
+}
+
+void HistoryLog::recordsBefore(uint64_t& from, size_t count, std::vector<uint64_t>& older) const
+{
+    // record starts are only known at index entries, read forward from the one before
+    std::vector<uint64_t> starts;
+    older.clear();
+    size_t i = entriesBefore(from);
+    while (count > 0 && i > 0)
+    {
+        const uint64_t segment = entry(--i);
+        starts.clear();
+        for (uint64_t offset = segment; offset < from;)
+        {
+            const size_t size = recordSize(mappedLog, from, offset);
+            if (size == 0) break;
+            starts.push_back(offset);
+            offset += size;
+        }
+        const size_t taken = std::min(count, starts.size());
+        older.insert(older.begin(), starts.end() - taken, starts.end());
+        count -= taken;
+        from = taken < starts.size() ? starts[starts.size() - taken] : segment;
+    }
+}
+
+void HistoryLog::unloadOldest(size_t count)
+{
+    if (count == 0 || lastLoaded.empty()) return;
+    loadedFrom = count < lastLoaded.size() ? lastLoaded[count] : lastLoadedEnd;
+    lastLoaded.erase(lastLoaded.begin(), lastLoaded.begin() + std::min(count, lastLoaded.size()));
+}
+
+bool HistoryLog::loadedPosition(uint64_t& position)
+{
+    if (!skipForgotten()) return false;
+    position = loadedFrom;
+    return true;
+}
+
+void HistoryLog::remap()
+{
+    // the writer publishes the index first, so every mapped record is indexed
+    const uint64_t logEnd = writtenLog.load(std::memory_order_acquire);
+    mapFile(indexFd, writtenIndex.load(std::memory_order_acquire), mappedIndex, mappedIndexSize);
+    mapFile(logFd, logEnd, mappedLog, mappedLogSize);
+}
+
+bool HistoryLog::skipForgotten()
+{
+    if (forgotten == 0) return true;
+    remap();
+    for (size_t size; forgotten > 0 && (size = recordSize(mappedLog, mappedLogSize, loadedFrom)) > 0; --forgotten)
+        loadedFrom += size;
+    return forgotten == 0;
+}
+
+void HistoryLog::recover()
+{
+    struct stat st;
+    const size_t logFileSize = ::fstat(logFd, &st) == 0 ? static_cast<size_t>(st.st_size) : HeaderSize;
+    size_t indexFileSize = ::fstat(indexFd, &st) == 0 ? static_cast<size_t>(st.st_size) : HeaderSize;
+    indexFileSize -= (indexFileSize - HeaderSize) % EntrySize;
+
+    // the index trails the log, an entry past its end means they do not belong together
+    uint64_t offset = HeaderSize;
+    if (indexFileSize > HeaderSize)
+    {
+        char last[EntrySize];
+        if (::pread(indexFd, last, sizeof(last), indexFileSize - EntrySize) == sizeof(last))
+            offset = get<uint64_t>(last);
+        if (offset >= logFileSize)
+        {
+            offset = HeaderSize;
+            indexFileSize = HeaderSize;
+        }
+    }
+    if (::ftruncate(indexFd, indexFileSize) != 0)
+        throw std::runtime_error("Failed to repair history index " + path + ".hidx");
+    indexSize = indexFileSize;
+    const bool indexed = indexFileSize > HeaderSize;
+
+    std::vector<char> tail(logFileSize - offset);
+    if (::pread(logFd, tail.data(), tail.size(), offset) != static_cast<ssize_t>(tail.size())) tail.clear();
+    size_t end = 0;
+    sinceEntry = 0;
+    logSize = offset;
+    for (size_t size; (size = recordSize(tail.data(), tail.size(), end)) > 0; end += size)
+    {
+        if (sinceEntry == 0 && !(indexed && end == 0)) appendEntry(offset + end);
+        sinceEntry = (sinceEntry + 1) % IndexStride;
+    }
+    logSize = offset + end;
+    // a record torn by a crash, the next one is written in its place
+    if (logSize < logFileSize && ::ftruncate(logFd, logSize) != 0)
+        throw std::runtime_error("Failed to repair history log " + path + ".hlog");
+}
+
+void HistoryLog::appendEntry(uint64_t offset)
+{
+    std::string buffer;
+    put<uint64_t>(buffer, offset);
+    // a lost entry only makes reading that stretch slower
+    if (::pwrite(indexFd, buffer.data(), buffer.size(), indexSize) == static_cast<ssize_t>(buffer.size()))
+        indexSize += buffer.size();
+}
+
+size_t HistoryLog::entriesBefore(uint64_t offset) const
+{
+    size_t low = 0, high = mappedIndexSize > HeaderSize ? (mappedIndexSize - HeaderSize) / EntrySize : 0;
+    while (low < high)
+    {
+        const size_t middle = (low + high) / 2;
+        if (entry(middle) < offset) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+uint64_t HistoryLog::entry(size_t i) const
+{
+    return get<uint64_t>(mappedIndex + HeaderSize + i * EntrySize);
+}
+
+
+History::History(const std::string& directory, const std::vector<std::string>& channels)
+    : logs()
+    , mutex()
+    , pendingAvailable()
+    , pending(channels.size())
+    , stopping(false)
+    , writer()
+{
+    std::filesystem::create_directories(directory);
+    logs.reserve(channels.size());
+    for (const std::string& channel : channels)
+        logs.push_back(std::make_unique<HistoryLog>(directory, channel));
+    writer = NJThread("History", [this]{ run(); });
+}
+
+History::~History()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    pendingAvailable.notify_one();
+    writer.join();
+}
+
+void History::append(const EventMessage& message)
+{
+    if (message.channel >= logs.size()) return;
+    {
+        std::lock_guard lock(mutex);
+        HistoryLog::encode(message, pending[message.channel]);
+    }
+    pendingAvailable.notify_one();
+}
+
+bool History::loadOlder(uint16_t channel, size_t count, std::vector<EventMessage>& messages)
+{
+    return channel < logs.size() && logs[channel]->loadOlder(count, messages);
+}
+
+void History::unloadOldest(uint16_t channel, size_t count)
+{
+    if (channel < logs.size()) logs[channel]->unloadOldest(count);
+}
+
+void History::forget(uint16_t channel, size_t count)
+{
+    if (channel < logs.size()) logs[channel]->forget(count);
+}
+
+bool History::loadedPosition(uint16_t channel, uint64_t& position)
+{
+    return channel < logs.size() && logs[channel]->loadedPosition(position);
+}
+
+bool History::readOlder(uint16_t channel, uint64_t& from, size_t count, std::vector<EventMessage>& messages) const
+{
+    return channel < logs.size() && logs[channel]->readOlder(from, count, messages);
+}
+
+void History::run()
+{
+    std::vector<std::string> writing(pending.size());
+    for (;;)
+    {
+        bool stop;
+        {
+            std::unique_lock lock(mutex);
+            pendingAvailable.wait(lock, [this]
+            {
+                return stopping || std::any_of(pending.begin(), pending.end(),
+                                               [](const std::string& records){ return !records.empty(); });
+            });
+            stop = stopping;
+            writing.swap(pending);
+        }
+        for (size_t channel = 0; channel < writing.size(); ++channel)
+        {
+            if (writing[channel].empty()) continue;
+            logs[channel]->write(writing[channel]);
+            writing[channel].clear();
+        }
+        if (stop) return;
+    }
+}
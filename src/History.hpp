@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HarpoonEvents.hpp"
+#include "JThread.hpp"
+
+
+/// On-disk history of one channel, an append-only log and a sparse index
+/// of every IndexStride-th record. All integers little endian:
+///   log    "HLOG" u32 version
+///          record u32 length of the rest, i64 time (ms), u8 flags,
+///                 u8 sender length, u8 trip length, sender, trip, message
+///   index  "HIDX" u32 version
+///          entry  u64 offset of the record in the log
+/// Opening maps both files and only checks the records after the last
+/// index entry, so it takes the same time however long the history is.
+/// Records written since are mapped once reading reaches them.
+class HistoryLog
+{
+public:
+    static constexpr size_t IndexStride = 64;
+
+    HistoryLog(const std::string& directory, std::string_view channel);
+    ~HistoryLog();
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    /// serializes a message for write()
+    static void encode(const EventMessage& message, std::string& out);
+    /// appends encoded records and indexes them, only called by the writer
+    void write(std::string_view records);
+    /// up to count messages older than all loaded before, oldest first,
+    /// appended to messages; false once the start of the log is reached
+    bool loadOlder(size_t count, std::vector<EventMessage>& messages);
+    /// gives back the oldest count messages of the last loadOlder, the
+    /// next call returns them again
+    void unloadOldest(size_t count);
+    /// the oldest count messages loaded or written have left the scrollback,
+    /// loading goes on right before the first one after them
+    inline void forget(size_t count) { forgotten += count; }
+    /// start of the oldest record loaded so far, false while forgotten
+    /// ones are still on their way to the disk
+    bool loadedPosition(uint64_t& position);
+    /// like loadOlder, but before the record at from, which moves to the
+    /// oldest one read; leaves what is loaded alone
+    bool readOlder(uint64_t& from, size_t count, std::vector<EventMessage>& messages) const;
+
+private:
+    /// indexes the records after the last index entry, cuts off a torn tail
+    void recover();
+    void appendEntry(uint64_t offset);
+    /// maps what the writer has written since
+    void remap();
+    /// moves loadedFrom past the forgotten records written so far, true
+    /// once none are left
+    bool skipForgotten();
+    /// starts of up to count records before from, oldest first, moves from
+    /// to the first of them
+    void recordsBefore(uint64_t& from, size_t count, std::vector<uint64_t>& starts) const;
+    /// mapped entries starting before offset
+    size_t entriesBefore(uint64_t offset) const;
+    /// offset of the i-th indexed record
+    uint64_t entry(size_t i) const;
+    static constexpr size_t HeaderSize = 8;
+    static constexpr size_t EntrySize = 8;
+
+    std::string path;
+    int logFd;
+    int indexFd;
+    /// written by the writer thread only
+    uint64_t logSize;
+    uint64_t indexSize;
+    /// records since the last indexed one
+    size_t sinceEntry;
+    /// logSize and indexSize once written, for the render thread
+    std::atomic<uint64_t> writtenLog;
+    std::atomic<uint64_t> writtenIndex;
+
+    /// the files as far as written when last mapped, read by the render thread only
+    const char* mappedLog;
+    size_t mappedLogSize;
+    const char* mappedIndex;
+    size_t mappedIndexSize;
+    /// start of the oldest record loaded so far
+    uint64_t loadedFrom;
+    /// records after loadedFrom that left the scrollback
+    size_t forgotten;
+    /// record starts of the last loadOlder and where it began
+    std::vector<uint64_t> lastLoaded;
+    uint64_t lastLoadedEnd;
+};
+
+/// History of all channels, written by a background thread
+class History
+{
+public:
+    /// creates directory if needed, throws when a log cannot be opened or another
+    /// process has it open
+    History(const std::string& directory, const std::vector<std::string>& channels);
+    /// writes everything queued before returning
+    ~History();
+
+    /// queues the message for its channel's log, returns right away
+    void append(const EventMessage& message);
+    /// see HistoryLog::loadOlder
+    bool loadOlder(uint16_t channel, size_t count, std::vector<EventMessage>& messages);
+    /// see HistoryLog::unloadOldest
+    void unloadOldest(uint16_t channel, size_t count);
+    /// see HistoryLog::forget
+    void forget(uint16_t channel, size_t count);
+    /// see HistoryLog, false for a channel without a log
+    bool loadedPosition(uint16_t channel, uint64_t& position);
+    bool readOlder(uint16_t channel, uint64_t& from, size_t count, std::vector<EventMessage>& messages) const;
+
+private:
+    void run();
+
+    std::vector<std::unique_ptr<HistoryLog>> logs;
+    std::mutex mutex;
+    std::condition_variable pendingAvailable;
+    /// encoded records by channel
+    std::vector<std::string> pending;
+    bool stopping;
+    NJThread writer;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+
+/// Fixed capacity string stored in place, longer input is truncated.
+template<size_t Capacity>
+class InlineString
+{
+    static_assert(Capacity < 256, "InlineString stores its length in one byte");
+
+public:
+    inline InlineString() : length(0) { }
+    inline explicit InlineString(std::string_view value) { assign(value); }
+
+    inline void assign(std::string_view value)
+    {
+        length = static_cast<uint8_t>(value.size() < Capacity ? value.size() : Capacity);
+        std::memcpy(data, value.data(), length);
+    }
+    inline void clear() { length = 0; }
+
+    inline std::string_view view() const { return std::string_view(data, length); }
+    inline size_t size() const { return length; }
+    inline bool empty() const { return length == 0; }
+
+private:
+    char data[Capacity];
+    uint8_t length;
+};
@@ -0,0 +1,104 @@
+#include "InternedString.hpp"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+struct InternedString::Table
+{
+    /// strings looked up at once by different connections rarely share a lock
+    static constexpr size_t ShardCount = 16;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string_view, std::unique_ptr<Entry>> strings;
+    };
+
+    inline Shard& shard(std::string_view value)
+    {
+        return shards[std::hash<std::string_view>()(value) % ShardCount];
+    }
+
+    Shard shards[ShardCount];
+};
+
+InternedString::Table& InternedString::table()
+{
+    static Table instance;
+    return instance;
+}
+
+InternedString::Entry InternedString::emptyEntry{std::string(), {0}};
+
+InternedString::InternedString()
+    : entry(&emptyEntry)
+{
+}
+
+InternedString::InternedString(std::string_view view)
+    : entry(&emptyEntry)
+{
+    if (view.empty()) return;
+    // consecutive messages are often from the same sender
+    thread_local InternedString last;
+    if (last.view() == view)
+    {
+        entry = last.entry;
+        acquire();
+        return;
+    }
+    auto& shard = table().shard(view);
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.strings.find(view);
+        if (it == shard.strings.end())
+        {
+            auto owned = std::make_unique<Entry>();
+            owned->value = view;
+            owned->references.store(0, std::memory_order_relaxed);
+            const std::string_view key(owned->value);
+            it = shard.strings.emplace(key, std::move(owned)).first;
+        }
+        // revived under the lock, so release() never frees an entry found here
+        entry = it->second.get();
+        acquire();
+    }
+    last = *this;
+}
+
+InternedString& InternedString::operator=(const InternedString& other)
+{
+    other.acquire();
+    release();
+    entry = other.entry;
+    return *this;
+}
+
+InternedString& InternedString::operator=(InternedString&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        entry = other.entry;
+        other.entry = &emptyEntry;
+    }
+    return *this;
+}
+
+void InternedString::release()
+{
+    if (entry == &emptyEntry) return;
+    // only the last handle takes the lock, it cannot be copied meanwhile
+    uint32_t references = entry->references.load(std::memory_order_relaxed);
+    while (references > 1)
+    {
+        if (entry->references.compare_exchange_weak(references, references - 1, std::memory_order_release,
+                                                    std::memory_order_relaxed))
+            return;
+    }
+    auto& shard = table().shard(entry->value);
+    std::lock_guard lock(shard.mutex);
+    if (entry->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        shard.strings.erase(shard.strings.find(entry->value));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+
+/// Handle to a shared string, kept as long as a handle refers to it.
+/// Equal strings share one instance, so comparing handles is as cheap as
+/// comparing pointers. Copying one counts a reference, the last handle
+/// gone takes the string out of the table again, so nicks of long gone
+/// users do not pile up.
+class InternedString
+{
+public:
+    InternedString();
+    explicit InternedString(std::string_view value);
+    inline InternedString(const InternedString& other) : entry(other.entry) { acquire(); }
+    inline InternedString(InternedString&& other) noexcept : entry(other.entry) { other.entry = &emptyEntry; }
+    inline ~InternedString() { release(); }
+    InternedString& operator=(const InternedString& other);
+    InternedString& operator=(InternedString&& other) noexcept;
+
+    inline const std::string& str() const { return entry->value; }
+    inline std::string_view view() const { return entry->value; }
+    inline size_t size() const { return entry->value.size(); }
+    inline bool empty() const { return entry->value.empty(); }
+
+    inline bool operator==(const InternedString& other) const { return entry == other.entry; }
+    inline bool operator!=(const InternedString& other) const { return entry != other.entry; }
+
+private:
+    friend struct std::hash<InternedString>;
+
+    struct Entry
+    {
+        std::string value;
+        /// handles referring to it, the empty string is not counted
+        std::atomic<uint32_t> references;
+    };
+
+    inline void acquire() const
+    {
+        if (entry != &emptyEntry) entry->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    void release();
+
+    /// all strings with a handle, defined with the lookups
+    struct Table;
+    static Table& table();
+
+    static Entry emptyEntry;
+    Entry* entry;
+};
+
+namespace std
+{
+template<>
+struct hash<InternedString>
+{
+    inline size_t operator()(const InternedString& s) const { return std::hash<const void*>()(s.entry); }
+};
+}
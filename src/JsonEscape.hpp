@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+
+/// appends text as the content of a JSON string, without quotes
+inline void appendJsonEscaped(std::string& out, std::string_view text)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t begin = 0;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out.append(text.data() + begin, i - begin);
+        begin = i + 1;
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+        }
+    }
+    out.append(text.data() + begin, text.size() - begin);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+/// Log-linear histogram, 8 buckets per power of two, so a reported
+/// percentile is at most 12.5% above the recorded value.
+class LatencyHistogram
+{
+public:
+    inline LatencyHistogram() : buckets{}, samples(0), maximum(0) { }
+
+    inline void record(uint64_t value)
+    {
+        ++buckets[indexOf(value)];
+        ++samples;
+        if (value > maximum) maximum = value;
+    }
+
+    /// upper bound of the bucket holding the given fraction, e.g. 0.99
+    inline uint64_t percentile(double fraction) const
+    {
+        if (samples == 0) return 0;
+        const uint64_t rank = static_cast<uint64_t>(fraction * (samples - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+            {
+                const uint64_t upper = i + 1 < BucketCount ? lowerBound(i + 1) - 1 : maximum;
+                return upper < maximum ? upper : maximum;
+            }
+        }
+        return maximum;
+    }
+
+    inline uint64_t count() const { return samples; }
+    inline uint64_t max() const { return maximum; }
+
+private:
+    static constexpr size_t SubBuckets = 8;
+    static constexpr size_t BucketCount = SubBuckets + 61 * SubBuckets;
+
+    static inline size_t indexOf(uint64_t value)
+    {
+        if (value < SubBuckets) return static_cast<size_t>(value);
+        const unsigned msb = 63 - __builtin_clzll(value);
+        const unsigned shift = msb - 3;
+        return SubBuckets + shift * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+    }
+    static inline uint64_t lowerBound(size_t index)
+    {
+        if (index < SubBuckets) return index;
+        const size_t shift = (index - SubBuckets) / SubBuckets;
+        return (SubBuckets + (index - SubBuckets) % SubBuckets) << shift;
+    }
+
+    std::array<uint64_t, BucketCount> buckets;
+    uint64_t samples;
+    uint64_t maximum;
+};
@@ -0,0 +1,125 @@
+#include "LineWrapper.hpp"
+#include <algorithm>
+#include <cwchar>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+inline bool isPlainAscii(unsigned char c)
+{
+    return c >= 0x20 && c < 0x7f;
+}
+
+/// length of the run of printable ASCII starting at pos, each byte is one column
+size_t plainRun(std::string_view text, size_t pos)
+{
+    const size_t begin = pos;
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; pos + 16 <= text.size(); pos += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        // signed compare, bytes >= 0x80 are negative and count as special too
+        const __m128i special = _mm_or_si128(_mm_cmplt_epi8(chunk, space), _mm_cmpeq_epi8(chunk, del));
+        const int mask = _mm_movemask_epi8(special);
+        if (mask != 0) return pos + __builtin_ctz(mask) - begin;
+    }
+#endif
+    while (pos < text.size() && isPlainAscii(text[pos])) ++pos;
+    return pos - begin;
+}
+
+/// decodes the code point at pos, invalid sequences decode as U+FFFD of one byte
+size_t decode(std::string_view text, size_t pos, char32_t& codePoint)
+{
+    const unsigned char lead = text[pos];
+    size_t length;
+    char32_t minimum;
+    if (lead < 0x80)      { codePoint = lead; return 1; }
+    else if (lead < 0xc0) { codePoint = 0xfffd; return 1; }
+    else if (lead < 0xe0) { codePoint = lead & 0x1f; length = 2; minimum = 0x80; }
+    else if (lead < 0xf0) { codePoint = lead & 0x0f; length = 3; minimum = 0x800; }
+    else if (lead < 0xf8) { codePoint = lead & 0x07; length = 4; minimum = 0x10000; }
+    else                  { codePoint = 0xfffd; return 1; }
+
+    if (pos + length > text.size())
+    {
+        codePoint = 0xfffd;
+        return 1;
+    }
+    for (size_t i = 1; i < length; ++i)
+    {
+        const unsigned char c = text[pos + i];
+        if ((c & 0xc0) != 0x80)
+        {
+            codePoint = 0xfffd;
+            return 1;
+        }
+        codePoint = (codePoint << 6) | (c & 0x3f);
+    }
+    if (codePoint < minimum || codePoint > 0x10ffff || (codePoint >= 0xd800 && codePoint < 0xe000))
+    {
+        codePoint = 0xfffd;
+        return 1;
+    }
+    return length;
+}
+
+size_t columns(char32_t codePoint)
+{
+    const int width = wcwidth(static_cast<wchar_t>(codePoint));
+    // ncurses draws control characters as ^X
+    return width < 0 ? 2 : static_cast<size_t>(width);
+}
+
+}
+
+void wrapLines(std::string_view text, size_t firstWidth, size_t width, std::vector<LineSlice>& lines)
+{
+    const size_t firstLine = lines.size();
+    size_t lineStart = 0;
+    size_t used = 0;
+    size_t available = std::max<size_t>(firstWidth, 1);
+    width = std::max<size_t>(width, 1);
+
+    auto endLine = [&](size_t end, size_t next)
+    {
+        lines.push_back({static_cast<uint32_t>(lineStart), static_cast<uint32_t>(end - lineStart)});
+        lineStart = next;
+        used = 0;
+        available = width;
+    };
+
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        for (size_t run = plainRun(text, pos); run > 0;)
+        {
+            if (used == available) endLine(pos, pos);
+            const size_t take = std::min(run, available - used);
+            used += take;
+            pos += take;
+            run -= take;
+        }
+        if (pos >= text.size()) break;
+
+        if (text[pos] == '\n')
+        {
+            endLine(pos, pos + 1);
+            ++pos;
+            continue;
+        }
+        char32_t codePoint;
+        const size_t length = decode(text, pos, codePoint);
+        const size_t cells = columns(codePoint);
+        // a character wider than the line still gets one of its own
+        if (used + cells > available && used > 0) endLine(pos, pos);
+        used += cells;
+        pos += length;
+    }
+    if (lineStart < text.size() || lines.size() == firstLine) endLine(text.size(), text.size());
+}
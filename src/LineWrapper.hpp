@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+/// one wrapped line, a byte range of the wrapped text
+struct LineSlice
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+/// lines stored elsewhere, e.g. in an arena
+struct LineSpan
+{
+    const LineSlice* data;
+    size_t count;
+
+    inline size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline const LineSlice& operator[](size_t i) const { return data[i]; }
+    inline const LineSlice* begin() const { return data; }
+    inline const LineSlice* end() const { return data + count; }
+};
+
+/// Wraps UTF-8 text in a single pass without copying it. Line feeds end
+/// a line, otherwise a line ends before the first character that would
+/// exceed the width in terminal columns (wcwidth, so wide CJK characters
+/// take two and combining marks none). The first line has firstWidth
+/// columns, all others width. Appends at least one line to lines.
+void wrapLines(std::string_view text, size_t firstWidth, size_t width, std::vector<LineSlice>& lines);
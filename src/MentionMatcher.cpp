@@ -0,0 +1,75 @@
+#include "MentionMatcher.hpp"
+#include <deque>
+#include "AsciiFold.hpp"
+
+MentionMatcher::MentionMatcher(const std::vector<std::string>& words)
+    : states(1)
+{
+    // 0 doubles as "no transition yet" while building the trie, the root is never a target
+    states[0].next.fill(0);
+    for (const std::string& word : words)
+    {
+        if (word.empty()) continue;
+        uint32_t state = 0;
+        for (char c : word)
+        {
+            const unsigned char key = asciiLower(static_cast<unsigned char>(c));
+            if (states[state].next[key] == 0)
+            {
+                states[state].next[key] = static_cast<uint32_t>(states.size());
+                states.emplace_back();
+                states.back().next.fill(0);
+            }
+            state = states[state].next[key];
+        }
+        states[state].words.push_back(static_cast<uint32_t>(word.size()));
+    }
+
+    // breadth first: missing transitions follow the suffix link, outputs are inherited from it
+    std::vector<uint32_t> link(states.size(), 0);
+    std::deque<uint32_t> pending;
+    for (uint32_t target : states[0].next)
+        if (target != 0) pending.push_back(target);
+    while (!pending.empty())
+    {
+        const uint32_t state = pending.front();
+        pending.pop_front();
+        const std::vector<uint32_t>& inherited = states[link[state]].words;
+        states[state].words.insert(states[state].words.end(), inherited.begin(), inherited.end());
+        for (size_t c = 0; c < 256; ++c)
+        {
+            const uint32_t target = states[state].next[c];
+            if (target != 0)
+            {
+                link[target] = states[link[state]].next[c];
+                pending.push_back(target);
+            }
+            else
+            {
+                states[state].next[c] = states[link[state]].next[c];
+            }
+        }
+    }
+    // upper case bytes take the lower case transitions
+    for (State& state : states)
+        for (unsigned char c = 'A'; c <= 'Z'; ++c)
+            state.next[c] = state.next[asciiLower(c)];
+}
+
+bool MentionMatcher::matches(std::string_view text) const
+{
+    if (states.size() == 1) return false;
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        state = states[state].next[static_cast<unsigned char>(text[i])];
+        for (uint32_t length : states[state].words)
+        {
+            const size_t start = i + 1 - length;
+            const bool wordStart = start == 0 || !isWordChar(text[start-1]);
+            const bool wordEnd = i + 1 == text.size() || !isWordChar(text[i+1]);
+            if (wordStart && wordEnd) return true;
+        }
+    }
+    return false;
+}
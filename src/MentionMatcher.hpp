@@ -0,0 +1,29 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/// Aho-Corasick automaton over a fixed list of words, e.g. the own nick
+/// and highlight words. One pass over a message finds whether any of them
+/// occurs as a whole word, ignoring ASCII case.
+class MentionMatcher
+{
+public:
+    explicit MentionMatcher(const std::vector<std::string>& words = {});
+
+    bool matches(std::string_view text) const;
+
+private:
+    struct State
+    {
+        /// complete transition table, by lowered byte
+        std::array<uint32_t, 256> next;
+        /// lengths of the words ending here, including through suffix links
+        std::vector<uint32_t> words;
+    };
+
+    std::vector<State> states;
+};
@@ -1,14 +1,14 @@
 #include "NCurses.hpp"
+#include <cstdio>
 #include <iostream>
-#include <sstream>
 #include <map>
 #include <algorithm>
 #include <iterator>
 #include <string_view>
-#include <boost/date_time.hpp>
 #include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 #include <ncurses.h>
-#include <utf8.h>
 #include "HarpoonEvents.hpp"
 #include "HackChatEvents.hpp"
 #include "enums/MessageType.hpp"
@@ -25,170 +25,61 @@
 #define PAIR_STATUS 5
 #define PAIR_MENTION 6
 
-class BacklogMessage
-{
-public:
-    BacklogMessage(const EventMessage& event);
-    std::vector<std::string>& getMessageWithBreaks(size_t messageWidth);
-    size_t getMessageLines(size_t messageWidth);
-    const EventMessage& getEvent() const;
-    size_t getPrefixLength();
-
-private:
-    /// constructs a string which already considers linebreaks and can be printed in one step
-    void computeMessageWithBreaks(size_t messageWidth);
-
-    EventMessage event;
-    size_t calculatedPrefixLength;
-    size_t calculatedMessageWidth;
-    std::vector<std::string> messageWithBreaks;
-};
-
-template<class Map, class K, class V>
-static auto getMapValue(const Map& map, const K& key, V&& otherwise)
-{
-    auto it = map.find(key);
-    if (it != map.end()) return it->second;
-    return otherwise;
-}
-
-template<class Map, class K, class V>
-static bool compareMapValue(const Map& map, const K& key, const V& value)
-{
-    auto it = map.find(key);
-    if (it == map.end()) return false;
-    return it->second == value;
-}
-
-
-BacklogMessage::BacklogMessage(const EventMessage& event)
-    : event(event)
-    , calculatedPrefixLength(0)
-    , calculatedMessageWidth(0)
-    , messageWithBreaks()
-{
-}
-const EventMessage& BacklogMessage::getEvent() const
-{
-    return event;
-}
-std::vector<std::string>& BacklogMessage::getMessageWithBreaks(size_t maxMessageWidth)
-{
-    computeMessageWithBreaks(maxMessageWidth);
-    return messageWithBreaks;
-}
-size_t BacklogMessage::getMessageLines(size_t maxMessageWidth)
-{
-    computeMessageWithBreaks(maxMessageWidth);
-    return messageWithBreaks.size();
-}
-size_t BacklogMessage::getPrefixLength()
-{
-    if (calculatedPrefixLength != 0) return calculatedPrefixLength;
-
-    const bool isMod = compareMapValue(event.extra, "mod", "1");
-    const bool isMe = event.type == MessageType::Me;
-    const bool isWhisper = event.type == MessageType::Whisper;
-    const bool isStatus = event.type == MessageType::Status;
-    const std::string& trip = getMapValue(event.extra,
-                                          "trip",
-                                          std::string());
-    calculatedPrefixLength = (trip.empty() ? 0 : trip.size()+1)
-                             + ((isMe || isWhisper) ? 0 : event.sender.size() + 3);
-    return calculatedPrefixLength;
-}
-
-void BacklogMessage::computeMessageWithBreaks(size_t maxMessageWidth)
+NCurses::NCurses(EventQueue& queue, hackchat::ConnectionManager& connections, SimpleSignalHandler& signalHandler,
+                 const Options& options)
+    : queue(queue)
+    , connections(connections)
+    , signalHandler(signalHandler)
+    , timeFormat(options.timeFormat)
+    , textColumn(static_cast<int>(options.timeFormat.width()) + 3)
+    , render(options.maxFps)
+    , nick(options.nick)
+    , mentions([&options]{
+          std::vector<std::string> words = options.highlights;
+          if (!options.nick.empty()) words.push_back(options.nick);
+          return words;
+      }())
+    , history()
+    , appended(0)
+    , usersDirtyFrom(Roster::npos)
+    , usersDrawn(0)
+    , rewrapWorkers("Rewrap", std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u))
+    , channels()
+    , activeChannel(0)
+    , completions()
+    , completionIndex(0)
+    , completionStart(0)
+    , searchResults()
+    , searchCursor(0)
+    , pendingSearch()
+    , matchPending(false)
+    , ingested(0)
 {
-    if (calculatedMessageWidth == maxMessageWidth) return;
-    const size_t firstLinePrefixLenght = getPrefixLength();
-
-    messageWithBreaks.clear();
-
-    // only do updates if there is enough space to display anything
-    if (maxMessageWidth > firstLinePrefixLenght)
+    channels.reserve(connections.size());
+    for (size_t i = 0; i < connections.size(); ++i)
     {
-        std::wstringstream wmessageWithBreaksStream;
-        size_t index = 0;
-        size_t lastCopyEnd = 0;
-        size_t offsetCount = 0;
-
-        std::string out;
-        std::wstring wout;
-
-        std::wstring wmessage;
-        utf8::utf8to32(event.message.begin(), event.message.end(),
-                       std::back_inserter(wmessage));
-        for (int j = 0; j < wmessage.size(); ++j)
-        {
-            ++index;
-            ++offsetCount;
-            if (event.message[j] == '\n')
-            {
-                wout = std::wstring(&wmessage[lastCopyEnd], offsetCount-1);
-                out.clear();
-                utf8::utf32to8(wout.begin(), wout.end(), std::back_inserter(out));
-                messageWithBreaks.push_back(std::move(out));
-                lastCopyEnd = index;
-                offsetCount = 0;
-                if (event.message[j+1] == '\0') { continue; }
-            }
-            else if (offsetCount >= maxMessageWidth - (messageWithBreaks.size() ? 0 : firstLinePrefixLenght))
-            {
-                wout = std::wstring(&wmessage[lastCopyEnd], offsetCount);
-                out.clear();
-                utf8::utf32to8(wout.begin(), wout.end(), std::back_inserter(out));
-                messageWithBreaks.push_back(std::move(out));
-                lastCopyEnd = index;
-                offsetCount = 0;
-                if (event.message[j+1] == '\n') { ++lastCopyEnd; ++j; }
-                if (event.message[j+1] == '\0') { continue; }
-            }
-        }
-        wout = std::wstring(&wmessage[lastCopyEnd], offsetCount);
-        out.clear();
-        utf8::utf32to8(wout.begin(), wout.end(), std::back_inserter(out));
-        messageWithBreaks.push_back(std::move(out));
+        channels.emplace_back(options.scrollback, options.scrollbackBytes, &rewrapWorkers, [this]{ this->queue.interrupt(); });
+        channels.back().name = connections.channel(i);
+        channels.back().historyFrom = channels.back().backlog.nextSequence();
+    }
+    if (!options.historyDirectory.empty())
+    {
+        std::vector<std::string> names;
+        for (const Channel& channel : channels) names.push_back(channel.name);
+        history = std::make_unique<History>(options.historyDirectory, names);
+        // enough for the first screen, older messages follow when scrolling up
+        for (size_t i = 0; i < channels.size(); ++i)
+            loadHistory(i);
     }
-    calculatedMessageWidth = maxMessageWidth;
-}
 
-NCurses::NCurses(EventQueue& queue, HackChatEventQueue& hackChatQueue)
-    : queue(queue)
-    , hackChatQueue(hackChatQueue)
-{
+    render.mark(DamageLayout);
     setlocale(LC_ALL, ""); 
     initscr();
-    eventHandlerThread = NJThread(
-        "ncursesEventHandler",
-        [this]
-        {
-            while (RUNNING)
-            {
-                if (const auto& optMessage = this->queue.pop())
-                    std::visit(
-                        [this](auto&& e)
-                        {
-                            using Type = std::decay_t<decltype(*e)>;
-                            if constexpr(std::is_same_v<Type, EventInput>) return this->onInput(*e);
-                            if constexpr(std::is_same_v<Type, EventUserList>) return this->onUserList(*e);
-                            if constexpr(std::is_same_v<Type, EventUserChanged>) return this->onUserChanged(*e);
-                            if constexpr(std::is_same_v<Type, EventMessage>) return this->onMessage(*e);
-                        }, *optMessage);
-            }
-        });
     t = NJThread(
         "NCurses",
         [this]
         {
             int newdy, newdx, dy, dx, usersw_dx=30; // dimensions
-            bool    resize = false,
-              redrawborder = false,
-               redrawinput = false,
-                redrawchat = false;
-            redraw = true;
-            redrawusers = false;
-            scrollOffset = 0;
 
             start_color();
             use_default_colors();
@@ -212,14 +103,42 @@ NCurses::NCurses(EventQueue& queue, HackChatEventQueue& hackChatQueue)
             newdx = dx;
             newdy = dy;
 
-            WINDOW *w, *usersw, *inputw;
+            WINDOW *w = 0, *usersw = 0, *inputw = 0;
+            chatw = 0;
+
+            std::vector<Event> batch;
+            pollfd fds[3] = {
+                {STDIN_FILENO, POLLIN, 0},
+                {this->queue.fd(), POLLIN, 0},
+                {this->signalHandler.fd(), POLLIN, 0}};
 
             while (RUNNING)
             {
-                int k;
-                static int time = 0;
+                while (int sig = this->signalHandler.next())
+                {
+                    if (sig == SIGWINCH) // ncurses' own handler is blocked, KEY_RESIZE follows
+                    {
+                        winsize ws;
+                        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) resizeterm(ws.ws_row, ws.ws_col);
+                    }
+                }
+                if (!RUNNING) break;
+
+                this->queue.tryDrain(batch);
+                render.countEvents(batch.size());
+                for (auto& event : batch) dispatch(event);
+                batch.clear();
+
+                for (auto& channel : channels)
+                {
+                    // lines below an anchored view changed, it has to move up
+                    if (channel.backlog.update() && channel.anchor && &channel == &channels[activeChannel])
+                        render.mark(DamageChat);
+                }
 
-                if (redraw)
+                // a burst of events since the last frame is drawn at once
+                unsigned damage = render.take(RenderScheduler::Clock::now());
+                if (damage & DamageLayout)
                 {
                     if (newdy != dy || newdx != dx)
                     {
@@ -234,7 +153,6 @@ NCurses::NCurses(EventQueue& queue, HackChatEventQueue& hackChatQueue)
                         usersw = 0;
                         w = 0;
 
-                        resize = true;
                         dx = newdx;
                         dy = newdy;
                         touchwin(stdscr);
@@ -245,221 +163,243 @@ NCurses::NCurses(EventQueue& queue, HackChatEventQueue& hackChatQueue)
                         std::ofstream("ncurses.log", std::ios_base::app) << "Resized stdscr to " << tx << "x" << ty << "\n";
 #endif
                     }
-                    redrawborder = true;
-                    redrawchat = true;
-                    redrawusers = true;
-                    redrawinput = true;
-                    redraw = false;
-                }
-                if (redrawborder)
-                {
                     if (!w)
                     {
                         w = newwin(dy, dx, 0, 0);
                         wbkgd(w, COLOR_PAIR(PAIR_BG));
                     }
                     werase(w);
-                    if (resize)
+                    wborder(w, 0, 0, 0, 0, 0, ACS_TTEE, 0, ACS_BTEE);
+                    mvwprintw(w, dy-1, 1, channels.size() > 1 ? "F2/F3-Channel F10-Quit" : "F10-Quit");
+                    damage |= DamageTabs | DamageChat | DamageUsers | DamageInput;
+                }
+                if (damage & DamageTabs)
+                {
+                    // channel tabs, * marks unread messages
+                    int x = 1;
+                    const int xMax = dx-1-usersw_dx;
+                    mvwhline(w, 0, 1, 0, xMax-1);
+                    for (size_t c = 0; c < channels.size() && x < xMax; ++c)
                     {
-                        touchwin(w);
-                        wnoutrefresh(w);
-                        wresize(w, dy, dx);
-#ifdef USE_DEBUGLOG
-                        int ty, tx;
-                        getmaxyx(w, ty, tx);
-                        std::ofstream("ncurses.log", std::ios_base::app) << "Resized w to " << tx << "x" << ty << "\n";
-#endif
+                        const Channel& channel = channels[c];
+                        const std::string tab = (c == activeChannel ? "[?" : " ?") + channel.name
+                                                + (c == activeChannel ? "]" : channel.unread ? "*" : " ");
+                        if (c == activeChannel) wattron(w, A_BOLD);
+                        mvwaddnstr(w, 0, x, tab.c_str(), std::min<int>(tab.size(), xMax-x));
+                        if (c == activeChannel) wattroff(w, A_BOLD);
+                        x += tab.size();
                     }
-                    wborder(w, 0, 0, 0, 0, 0, ACS_TTEE, 0, ACS_BTEE);
-                    mvwprintw(w, dy-1, 1, "F10-Quit");
-                    wrefresh(w);
-                    redrawborder = false;
                 }
-                if (redrawchat)
+                if (damage & (DamageLayout | DamageTabs)) wnoutrefresh(w);
+                if (damage & (DamageChat | DamageAppend))
                 {
                     if (!chatw)
                     {
                         chatw = subwin(w, dy-3, dx-2-usersw_dx, 1, 1);
                     }
-                    werase(chatw);
-                    if (resize)
+                    Channel& channel = channels[activeChannel];
+                    Backlog& backlog = channel.backlog;
+                    const int rows = dy-3;
+                    const size_t messageWidth = getmaxx(chatw)-textColumn;
+                    if (backlog.width() != messageWidth)
                     {
-                        touchwin(chatw);
-                        wnoutrefresh(chatw);
-                        wresize(chatw, dy-3, dx-2-usersw_dx);
-#ifdef USE_DEBUGLOG
-                        int ty, tx;
-                        getmaxyx(chatw, ty, tx);
-                        std::ofstream("ncurses.log", std::ios_base::app) << "Resized chat to " << tx << "x" << ty << "\n";
-#endif
+                        if (channel.scrollOffset > 0) channel.anchor = backlog.anchorAt(channel.scrollOffset);
+                        backlog.setWidth(messageWidth);
+                        damage |= DamageChat;
+                    }
+                    // new messages at the bottom scroll the pane, only their lines are drawn
+                    size_t appendedLines = 0;
+                    for (size_t m = 0; !(damage & DamageChat) && m < appended; ++m)
+                    {
+                        appendedLines += backlog.lines(m).size();
+                        if (appendedLines >= static_cast<size_t>(rows)) damage |= DamageChat;
                     }
+                    if (damage & DamageChat)
                     {
-                        int i = -scrollOffset;
-                        int iMax = dy-3;
-                        std::lock_guard lock(backlogMutex);
-                        for (auto& backlogMessage : backlog)
+                        werase(chatw);
+                        if (channel.anchor) channel.scrollOffset = backlog.lineOf(*channel.anchor);
+                        // only the screen is wrapped right away, the rest follows in the background
+                        backlog.rewrapVisible(channel.scrollOffset, rows);
+                        if (channel.anchor)
+                        {
+                            channel.scrollOffset = backlog.lineOf(*channel.anchor);
+                            if (!backlog.rewrapping()) channel.anchor.reset();
+                        }
+                        // scrolled past what is in memory
+                        bool paged = false;
+                        while (history && channel.scrollOffset >= 0 && rows > 0
+                               && static_cast<size_t>(channel.scrollOffset + rows) > backlog.totalLines()
+                               && loadHistory(activeChannel))
+                            paged = true;
+                        if (paged) backlog.rewrapVisible(channel.scrollOffset, rows);
+                        // start at the message holding the bottom line, skip everything newer
+                        const Backlog::Position start = backlog.seek(channel.scrollOffset);
+                        int i = static_cast<int>(start.linesBelow) - channel.scrollOffset;
+                        for (size_t m = start.message; m < backlog.size() && i < rows; ++m)
                         {
-                            if (i >= iMax) break;
-                            const bool isMod = compareMapValue(backlogMessage.getEvent().extra, "mod", "1");
-                            const bool isMe = backlogMessage.getEvent().type == MessageType::Me;
-                            const bool isWhisper = backlogMessage.getEvent().type == MessageType::Whisper;
-                            const bool isStatus = backlogMessage.getEvent().type == MessageType::Status;
-                            const std::string& trip = getMapValue(backlogMessage.getEvent().extra,
-                                                                  "trip",
-                                                                  std::string());
-                            size_t maxMessageWidth = getmaxx(chatw)-11;
-                            const std::vector<std::string>& message =
-                                    backlogMessage.getMessageWithBreaks(maxMessageWidth);
+                            const LineSpan lines = backlog.lines(m);
                             // shift chat N lines up
-                            i += backlogMessage.getMessageLines(maxMessageWidth);
-
-                            if (i > 0 && i < dy-2)
-                            {
-                                std::stringstream ss;
-                                ss.imbue(
-                                    std::locale(
-                                        std::locale::classic(),
-                                        new boost::posix_time::time_facet("%H:%M:%S")));
-                                ss << backlogMessage.getEvent().time;
-                                const std::string& timeStr = ss.str();
-                                mvwaddnstr(chatw, dy-3-i, 0, timeStr.c_str(), timeStr.size());
-                                waddstr(chatw, " | ");
-                                if (isStatus) wattron(chatw, COLOR_PAIR(PAIR_STATUS));
-                                if (isMe || isWhisper) wattron(chatw, A_ITALIC);
-                                if (!isMe && !isWhisper) waddstr(chatw, isStatus?"[":"<");
-                                if (!trip.empty())
-                                {
-                                    wattron(chatw, COLOR_PAIR(PAIR_TRIP));
-                                    waddnstr(chatw, trip.c_str(), trip.size());
-                                    wattroff(chatw, COLOR_PAIR(PAIR_TRIP));
-                                    waddch(chatw, ' ');
-                                }
-                                if (isWhisper || isMe) wattron(chatw, COLOR_PAIR(PAIR_STATUS));
-                                if (!isMe && !isWhisper)
-                                {
-                                    if (isMod) wattron(chatw, COLOR_PAIR(PAIR_MOD));
-                                    const auto& sender = backlogMessage.getEvent().sender;
-                                    waddnstr(chatw, sender.c_str(), sender.size());
-                                    if (isMod) wattroff(chatw, COLOR_PAIR(PAIR_MOD));
-                                }
-                                if (!isMe && !isWhisper) waddstr(chatw, isStatus?"]":">");
-                                if (!isMe && !isWhisper) waddch(chatw, ' ');
-                            }
-                            if (isWhisper || isMe) wattron(chatw, COLOR_PAIR(PAIR_STATUS));
-                            for (int j = 0; j < message.size(); ++j)
-                            {
-                                if (i>j && i-j < dy-2)
-                                {
-                                    mvwaddnstr(chatw,
-                                               dy-3-i+j, (j == 0 ? 11+backlogMessage.getPrefixLength() : 11),
-                                               message[j].c_str(), message[j].size());
-                                }
-                            }
-                            if (isMe || isWhisper) wattroff(chatw, A_ITALIC);
-                            if (isStatus || isMe || isWhisper) wattroff(chatw, COLOR_PAIR(PAIR_STATUS));
+                            i += lines.size();
+                            drawMessage(backlog.fromNewest(m), lines, i, rows);
                         }
                     }
-                    wrefresh(chatw);
-                    redrawchat = false;
+                    else
+                    {
+                        scrollok(chatw, TRUE);
+                        wscrl(chatw, static_cast<int>(appendedLines));
+                        scrollok(chatw, FALSE);
+                        int i = 0;
+                        for (size_t m = 0; m < appended; ++m)
+                        {
+                            const LineSpan lines = backlog.lines(m);
+                            i += lines.size();
+                            drawMessage(backlog.fromNewest(m), lines, i, rows);
+                        }
+                    }
+                    wnoutrefresh(chatw);
+                    appended = 0;
                 }
-                if (redrawusers)
+                if (damage & (DamageUsers | DamageUserRows))
                 {
                     if (!usersw)
                     {
                         usersw = subwin(w, dy, usersw_dx, 0, dx-usersw_dx);
                     }
-                    werase(usersw);
-                    if (resize)
+                    size_t first = usersDirtyFrom;
+                    if (damage & DamageUsers)
                     {
-                        touchwin(usersw);
-                        wnoutrefresh(usersw);
-                        wresize(usersw, getmaxy(w), usersw_dx);
-                        mvwin(usersw, 0, getmaxx(w)-usersw_dx);
+                        werase(usersw);
+                        wborder(usersw, 0, 0, 0, 0, ACS_TTEE, 0, ACS_BTEE, 0);
+                        first = 0;
+                        usersDrawn = 0;
                     }
-                    wborder(usersw, 0, 0, 0, 0, ACS_TTEE, 0, ACS_BTEE, 0);
+                    // a join or part shifts the rows below it, the ones above stay,
+                    // several parts in one frame leave as many stale rows at the end
+                    const Roster& users = channels[activeChannel].users;
+                    const size_t rows = dy > 2 ? dy-2 : 0;
+                    const int nickWidth = usersw_dx-2;
+                    auto it = first < users.size() ? users.nth(first) : users.end();
+                    const size_t last = std::min(rows, std::max(usersDrawn, users.size()));
+                    for (size_t row = first; row < last; ++row)
                     {
-                        int i = 0;
-                        std::lock_guard lock(usersMutex);
-                        for (const auto& user : users)
-                        {
-                            if (i >= dy-1) break;
-                            mvwaddnstr(usersw, ++i, 1, user.c_str(), user.size());
-                        }
+                        mvwhline(usersw, row+1, 1, ' ', nickWidth);
+                        if (it == users.end()) continue;
+                        mvwaddnstr(usersw, row+1, 1, it->data(), std::min<int>(it->size(), nickWidth));
+                        ++it;
                     }
-                    wrefresh(usersw);
-                    redrawusers = false;
+                    usersDirtyFrom = Roster::npos;
+                    usersDrawn = std::min(rows, users.size());
+                    wnoutrefresh(usersw);
                 }
-                if (redrawinput)
+                if (damage & DamageInput)
                 {
                     if (!inputw)
                     {
                         inputw = subwin(w, 1, dx-2-usersw_dx, dy-2, 1);
                         keypad(inputw, 1);
-                        wtimeout(inputw, 1000);
+                        wtimeout(inputw, 0);
                         wbkgd(inputw, COLOR_PAIR(PAIR_INPUTLINE));
                     }
                     werase(inputw);
                     mvwprintw(inputw, 0, 0, "%s", buffer.c_str());
-                    wrefresh(inputw);
-                    redrawinput = false;
+                    wnoutrefresh(inputw);
+                }
+                if (damage)
+                {
+                    // one write to the terminal for all panes
+                    doupdate();
+                    if (damage & (DamageChat | DamageAppend)) recordShown();
                 }
-                k = wgetch(inputw);
-                if (k != ERR)
+                int k;
+                while ((k = wgetch(inputw)) != ERR)
                 {
                     lastk = k;
+                    Channel& active = channels[activeChannel];
+                    int& scrollOffset = active.scrollOffset;
+                    const int scrolledFrom = scrollOffset;
+                    if (k != '\t') completions.clear();
                     if (k == KEY_RESIZE) // terminal was resized
                     {
                         getmaxyx(stdscr, newdy, newdx);
-                        redraw = true;
+                        render.mark(DamageLayout);
                     }
                     else if (k == KEY_UP)
                     {
                         scrollOffset += 1;
-                        redrawchat = true;
+                        render.mark(DamageChat);
                     }
                     else if (k == KEY_DOWN)
                     {
                         if (scrollOffset > 0) --scrollOffset;
                         else scrollOffset = 0;
-                        redrawchat = true;
+                        render.mark(DamageChat);
                     }
                     else if (k == KEY_END)
                     {
                         scrollOffset = 0;
-                        redrawchat = true;
+                        render.mark(DamageChat);
                     }
                     else if (k == KEY_PPAGE)
                     {
                         scrollOffset += dy-3;
-                        redrawchat = true;
+                        render.mark(DamageChat);
                     }
                     else if (k == KEY_NPAGE)
                     {
                         if (dy-3 > scrollOffset) scrollOffset = 0;
                         else scrollOffset -= dy-3;
-                        redrawchat = true;
+                        render.mark(DamageChat);
+                    }
+                    else if (k == KEY_F(2) && channels.size() > 1)
+                    {
+                        switchChannel((activeChannel + channels.size() - 1) % channels.size());
+                    }
+                    else if (k == KEY_F(3) && channels.size() > 1)
+                    {
+                        switchChannel((activeChannel + 1) % channels.size());
                     }
                     else if (k == KEY_F(10))
                     {
                         RUNNING = false;
                         break;
                     }
+                    else if (k == '\t')
+                    {
+                        completeNick();
+                    }
                     else if (k >= ' ' && k <= '~')
                     {
                         buffer += k;
-                        redrawinput = true;
+                        render.mark(DamageInput);
                     }
                     else if (k == KEY_BACKSPACE || k == 8 || k == 127)
                     {
                         if (!buffer.empty()) buffer.resize(buffer.size()-1);
-                        redrawinput = true;
+                        render.mark(DamageInput);
                     }
                     else if (k == '\r' || k == '\n')
                     {
-                        this->queue.push(std::make_shared<EventInput>(buffer));
+                        // handled right here, this thread is the only one draining the queue
+                        onInput(EventInput(buffer));
                         buffer = "";
-                        redrawinput = true;
+                        render.mark(DamageInput);
                     }
+                    if (active.anchor && scrollOffset != scrolledFrom)
+                        active.anchor = active.backlog.anchorAt(scrollOffset);
+                }
+                if (!RUNNING) break;
+                // search indexing runs between frames, not when a message arrives
+                bool indexing = false;
+                for (size_t i = 0; i < channels.size(); ++i)
+                    indexing = indexPending(i, IndexBudget / channels.size() + 1) || indexing;
+                indexing = stepSearch() || indexing;
+                // sleep until input, events or the next frame is due
+                const int timeout = indexing ? 0 : render.pollTimeout(RenderScheduler::Clock::now());
+                if (timeout == 0) continue;
+                if (this->queue.prepareWait())
+                {
+                    poll(fds, 3, timeout);
+                    this->queue.finishWait();
                 }
             }
         });
@@ -468,49 +408,423 @@ NCurses::NCurses(EventQueue& queue, HackChatEventQueue& hackChatQueue)
 NCurses::~NCurses()
 {
     RUNNING = false;
+    queue.interrupt();
     t.join();
     clear();
     endwin();
 }
 
+void NCurses::join()
+{
+    t.join();
+}
+
 void NCurses::onInput(const EventInput& event)
 {
-    hackChatQueue.push(std::make_shared<EventHackSendMessage>(event.message));
+    if (event.message == "/search" || event.message.compare(0, 8, "/search ") == 0)
+    {
+        search(std::string_view(event.message).substr(7));
+        return;
+    }
+    if (event.message == "/stats") addStatus(describeStats());
+    if (activeChannel < connections.size())
+        connections.queue(activeChannel).push(EventHackSendMessage(event.message));
 }
 
-void NCurses::onUserList(const EventUserList& event)
+void NCurses::onUserList(EventUserList&& event)
 {
-    std::lock_guard lock(usersMutex);
-    users = event.users;
-    redrawusers = true;
+    if (event.channel >= channels.size()) return;
+    channels[event.channel].users.assign(std::move(event.users));
+    if (event.channel == activeChannel) render.mark(DamageUsers);
 }
 void NCurses::onUserChanged(const EventUserChanged& event)
 {
-    std::lock_guard lock(usersMutex);
+    if (event.channel >= channels.size()) return;
+    Roster& users = channels[event.channel].users;
+    size_t row = Roster::npos;
     switch (event.changeType)
     {
         case UserChangeType::Add:
-            users.push_back(event.user);
+            row = users.add(event.user);
             break;
         case UserChangeType::Remove:
-            users.erase(std::find(users.begin(),
-                                  users.end(),
-                                  event.user));
+            row = users.remove(event.user);
             break;
     }
-    redrawusers = true;
+    if (event.channel == activeChannel && row != Roster::npos)
+    {
+        usersDirtyFrom = std::min(usersDirtyFrom, row);
+        render.mark(DamageUserRows);
+    }
 }
-void NCurses::onMessage(const EventMessage& event)
+void NCurses::onMessage(EventMessage&& event)
+{
+    if (event.channel < channels.size() && !event.flags.status && event.sender.view() != nick)
+        event.flags.mention = mentions.matches(event.message);
+    if (history) history->append(event);
+    addMessage(std::move(event));
+}
+
+void NCurses::addMessage(EventMessage&& message)
 {
-    addMessage(event);
+    if (message.channel >= channels.size())
+    {
+        queue.messages.release(std::move(message));
+        return;
+    }
+    Channel& channel = channels[message.channel];
+    Backlog& backlog = channel.backlog;
+    lastIngest = std::chrono::steady_clock::now();
+    if (ingested++ == 0) firstIngest = lastIngest;
+    const bool shown = &channel == &channels[activeChannel] && channel.scrollOffset == 0;
+    if (shown && !message.flags.status) pendingShown.push_back(message.time);
+
+    // the text is copied to the backlog's arena, the payload goes back to the producers
+    queue.messages.release(backlog.push(std::move(message)));
+    if (shown)
+    {
+        ++appended;
+        render.mark(DamageAppend);
+    }
+    else if (&channel == &channels[activeChannel])
+    {
+        // the view stays where it is, nothing on screen changes
+        channel.scrollOffset += backlog.lines(0).size();
+    }
+    else if (!channel.unread)
+    {
+        channel.unread = true; // only the tab changes
+        render.mark(DamageTabs);
+    }
+}
+
+void NCurses::addStatus(std::string text)
+{
+    EventMessage message("system", std::move(text), MessageType::Status);
+    message.channel = static_cast<uint16_t>(activeChannel);
+    onMessage(std::move(message));
+}
+
+void NCurses::completeNick()
+{
+    if (completions.empty())
+    {
+        completionStart = buffer.rfind(' ');
+        completionStart = completionStart == std::string::npos ? 0 : completionStart + 1;
+        if (completionStart < buffer.size() && buffer[completionStart] == '@') ++completionStart;
+        std::vector<std::string_view> matches;
+        channels[activeChannel].users.complete(std::string_view(buffer).substr(completionStart), matches, 32);
+        if (matches.empty()) return;
+        completions.assign(matches.begin(), matches.end());
+        completionIndex = 0;
+    }
+    else
+    {
+        completionIndex = (completionIndex + 1) % completions.size();
+    }
+    buffer.resize(completionStart);
+    buffer += completions[completionIndex];
+    buffer += ' ';
+    render.mark(DamageInput);
+}
+
+void NCurses::drawMessage(BacklogMessage& backlogMessage, LineSpan message, int i, int rows)
+{
+    const EventMessage::Flags flags = backlogMessage.getFlags();
+    const bool isMod = flags.mod;
+    const bool isMe = flags.me;
+    const bool isWhisper = flags.whisper;
+    const bool isStatus = flags.status;
+    const std::string_view trip = backlogMessage.getTrip();
+
+    if (i > 0 && i <= rows)
+    {
+        const std::string_view timeText = backlogMessage.getTimeText(timeFormat);
+        if (flags.mention) wattron(chatw, COLOR_PAIR(PAIR_MENTION));
+        mvwaddnstr(chatw, rows-i, 0, timeText.data(), timeText.size());
+        if (flags.mention) wattroff(chatw, COLOR_PAIR(PAIR_MENTION));
+        waddstr(chatw, " | ");
+        if (isStatus) wattron(chatw, COLOR_PAIR(PAIR_STATUS));
+        if (isMe || isWhisper) wattron(chatw, A_ITALIC);
+        if (!isMe && !isWhisper) waddstr(chatw, isStatus?"[":"<");
+        if (!trip.empty())
+        {
+            wattron(chatw, COLOR_PAIR(PAIR_TRIP));
+            waddnstr(chatw, trip.data(), trip.size());
+            wattroff(chatw, COLOR_PAIR(PAIR_TRIP));
+            waddch(chatw, ' ');
+        }
+        if (isWhisper || isMe) wattron(chatw, COLOR_PAIR(PAIR_STATUS));
+        if (!isMe && !isWhisper)
+        {
+            if (isMod) wattron(chatw, COLOR_PAIR(PAIR_MOD));
+            const std::string_view sender = backlogMessage.getSender();
+            waddnstr(chatw, sender.data(), sender.size());
+            if (isMod) wattroff(chatw, COLOR_PAIR(PAIR_MOD));
+        }
+        if (!isMe && !isWhisper) waddstr(chatw, isStatus?"]":">");
+        if (!isMe && !isWhisper) waddch(chatw, ' ');
+    }
+    if (isWhisper || isMe) wattron(chatw, COLOR_PAIR(PAIR_STATUS));
+    for (size_t j = 0; j < message.size(); ++j)
+    {
+        const int row = rows - i + static_cast<int>(j);
+        if (row >= 0 && row < rows)
+        {
+            const std::string_view line = backlogMessage.getLine(message[j]);
+            mvwaddnstr(chatw,
+                       row, (j == 0 ? textColumn+backlogMessage.getPrefixLength() : textColumn),
+                       line.data(), line.size());
+        }
+    }
+    if (isMe || isWhisper) wattroff(chatw, A_ITALIC);
+    if (isStatus || isMe || isWhisper) wattroff(chatw, COLOR_PAIR(PAIR_STATUS));
+}
+
+void NCurses::recordShown()
+{
+    const int64_t now = EventMessage::currentTime();
+    for (int64_t time : pendingShown)
+        latency.record(now > time ? now - time : 0);
+    pendingShown.clear();
+}
+
+bool NCurses::loadHistory(size_t index)
+{
+    Channel& channel = channels[index];
+    Backlog& backlog = channel.backlog;
+    forgetEvicted(index);
+    if (channel.historyLoaded || !backlog.roomForOlder()) return false;
+    std::vector<EventMessage> older;
+    const size_t count = std::min(HistoryPage, backlog.capacity() - backlog.size());
+    channel.historyLoaded = !history->loadOlder(static_cast<uint16_t>(index), count, older);
+    const uint64_t oldest = backlog.oldestSequence();
+    const size_t added = backlog.prepend(older);
+    channel.historyFrom = backlog.oldestSequence();
+    if (added < older.size())
+    {
+        // the scrollback is full, what did not fit stays on disk
+        history->unloadOldest(static_cast<uint16_t>(index), older.size() - added);
+        channel.historyLoaded = true;
+    }
+    if (added == 0) return false;
+
+    // indexed right away unless a search got to them first, the index only grows at its ends
+    SearchIndex& search = channel.search;
+    if (search.empty()) search.reset(oldest);
+    const uint64_t first = search.begin();
+    if (first > oldest) return true;
+    for (size_t i = older.size() - added; i < older.size(); ++i)
+    {
+        if (oldest - (older.size() - i) >= first)
+            channel.indexedAheadBytes -= std::min(channel.indexedAheadBytes, Backlog::bytesOf(older[i]));
+    }
+    if (first > backlog.oldestSequence())
+    {
+        std::vector<const BacklogMessage*> messages;
+        for (uint64_t sequence = backlog.oldestSequence(); sequence < first; ++sequence)
+            messages.push_back(&backlog.fromNewest(backlog.nextSequence() - 1 - sequence));
+        search.addOlder(messages);
+    }
+    return true;
+}
+
+void NCurses::forgetEvicted(size_t index)
+{
+    Channel& channel = channels[index];
+    const uint64_t oldest = channel.backlog.oldestSequence();
+    if (oldest <= channel.historyFrom) return;
+    if (history) history->forget(static_cast<uint16_t>(index), oldest - channel.historyFrom);
+    channel.historyFrom = oldest;
+    channel.historyLoaded = false;
+    // read again from the new position when there is room
+    if (channel.search.begin() < oldest) channel.search.dropBefore(oldest);
+    channel.indexedAheadBytes = 0;
+    channel.historyIndexed = false;
+}
+
+bool NCurses::indexPending(size_t index, size_t budget)
+{
+    Channel& channel = channels[index];
+    SearchIndex& search = channel.search;
+    const Backlog& backlog = channel.backlog;
+    const uint64_t oldest = backlog.oldestSequence();
+    if (search.end() < oldest) search.reset(oldest); // evicted before it was indexed
+    else if (oldest - search.begin() > std::max<size_t>(backlog.size() / 4, HistoryPage))
+    {
+        if (oldest > channel.historyFrom) forgetEvicted(index);
+        else if (!backlog.roomForOlder()) search.dropBefore(oldest); // indexed ahead but no longer fits
+    }
+    for (; search.end() < backlog.nextSequence() && budget > 0; --budget)
+        search.add(channel.backlog.fromNewest(backlog.nextSequence() - 1 - search.end()));
+    return search.end() < backlog.nextSequence();
+}
+
+bool NCurses::indexHistory(size_t index, size_t budget)
+{
+    Channel& channel = channels[index];
+    const Backlog& backlog = channel.backlog;
+    SearchIndex& search = channel.search;
+    if (!history) return false;
+    forgetEvicted(index);
+    if (channel.historyIndexed || !backlog.roomForOlder() || search.begin() > backlog.oldestSequence())
+        return false;
+    // the ids below the oldest message are the sequences paging in gives them
+    const uint64_t ahead = backlog.oldestSequence() - search.begin();
+    if (ahead == 0)
+    {
+        // evicted messages still on their way to the disk, searched without the history
+        if (!history->loadedPosition(static_cast<uint16_t>(index), channel.indexedFrom)) return false;
+        channel.indexedAheadBytes = 0;
+    }
+    // messages added since may have taken the room of those indexed ahead
+    const size_t room = backlog.capacity() - backlog.size() > ahead ? backlog.capacity() - backlog.size() - ahead : 0;
+    std::vector<EventMessage> older;
+    const bool more = history->readOlder(static_cast<uint16_t>(index), channel.indexedFrom,
+                                         std::min<uint64_t>({budget, room, search.begin()}), older);
+
+    // no further than the scrollback could page in
+    size_t taken = 0;
+    for (auto it = older.rbegin(); it != older.rend(); ++it, ++taken)
+    {
+        const size_t bytes = Backlog::bytesOf(*it);
+        if (backlog.budget() > 0 && backlog.bytes() + channel.indexedAheadBytes + bytes > backlog.budget()) break;
+        channel.indexedAheadBytes += bytes;
+    }
+    std::vector<BacklogMessage> messages(taken);
+    std::vector<const BacklogMessage*> pointers;
+    for (size_t i = 0; i < taken; ++i)
+    {
+        const EventMessage& message = older[older.size() - taken + i];
+        messages[i].assign(message, message.message);
+        pointers.push_back(&messages[i]);
+    }
+    search.addOlder(pointers);
+    channel.historyIndexed = !more || taken < older.size() || taken == room || taken == search.begin();
+    return !channel.historyIndexed;
+}
+
+void NCurses::search(std::string_view text)
+{
+    if (text.find_first_not_of(' ') != std::string_view::npos)
+    {
+        try
+        {
+            pendingSearch = SearchQuery::parse(text, EventMessage::currentTime());
+        }
+        catch (const std::invalid_argument& e)
+        {
+            addStatus(std::string("search: ") + e.what());
+            return;
+        }
+        // history on disk counts too, as much as the scrollback holds, indexed between frames
+        searchResults.clear();
+        searchCursor = 0;
+        matchPending = false;
+    }
+    else if (pendingSearch || matchPending)
+    {
+        return; // still on its way
+    }
+    else if (searchResults.empty())
+    {
+        addStatus("search: usage /search words [from:nick] [since:time] [until:time], /search again for older matches");
+    }
+    else
+    {
+        matchPending = true;
+    }
+}
+
+bool NCurses::stepSearch()
+{
+    Channel& channel = channels[activeChannel];
+    if (pendingSearch)
+    {
+        if (indexPending(activeChannel, IndexBudget) || indexHistory(activeChannel, IndexBudget)) return true;
+        searchResults = channel.search.find(*pendingSearch);
+        searchCursor = searchResults.size();
+        pendingSearch.reset();
+        matchPending = true;
+    }
+    if (!matchPending) return false;
+    // a page at a time up to an older match
+    if (history && searchCursor > 0 && searchResults[searchCursor-1] < channel.backlog.oldestSequence()
+        && loadHistory(activeChannel))
+        return true;
+    matchPending = false;
+    showMatch();
+    return false;
+}
+
+void NCurses::showMatch()
+{
+    Channel& channel = channels[activeChannel];
+    Backlog& backlog = channel.backlog;
+    // newest first, each /search without a query goes one match further up
+    if (searchCursor == 0 || searchResults[searchCursor-1] < backlog.oldestSequence())
+    {
+        addStatus(searchResults.empty() ? "search: nothing found" : "search: no older matches");
+        return;
+    }
+    const uint64_t id = searchResults[--searchCursor];
+    channel.anchor = Backlog::Anchor{id, 0};
+    channel.scrollOffset = static_cast<int>(backlog.lineOf(*channel.anchor));
+    render.mark(DamageChat);
+    char line[64];
+    std::snprintf(line, sizeof(line), "search: match %zu of %zu",
+                  searchResults.size() - searchCursor, searchResults.size());
+    addStatus(line);
+}
+
+std::string NCurses::describeStats() const
+{
+    const double seconds = std::chrono::duration<double>(lastIngest - firstIngest).count();
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "screen: messages=%llu rate=%.0f/s frame-to-screen p50=%llums p99=%llums max=%llums"
+                  " events=%llu frames=%llu",
+                  static_cast<unsigned long long>(ingested),
+                  seconds > 0 ? ingested / seconds : 0.0,
+                  static_cast<unsigned long long>(latency.percentile(0.5)),
+                  static_cast<unsigned long long>(latency.percentile(0.99)),
+                  static_cast<unsigned long long>(latency.max()),
+                  static_cast<unsigned long long>(render.events()),
+                  static_cast<unsigned long long>(render.frames()));
+    std::string report = line;
+
+    // over all channels, the rest of the used bytes are lines of older widths
+    size_t messages = 0, live = 0, used = 0, reserved = 0, chunks = 0, released = 0, slots = 0;
+    for (const Channel& channel : channels)
+    {
+        const ChunkArena::Stats arena = channel.backlog.arenaStats();
+        messages += channel.backlog.size();
+        live += channel.backlog.liveBytes();
+        used += arena.used;
+        reserved += arena.reserved;
+        chunks += arena.chunks;
+        released += arena.released;
+        slots += channel.backlog.bytes() - arena.reserved;
+    }
+    std::snprintf(line, sizeof(line),
+                  "\nbacklog: messages=%zu live=%zuKiB used=%zuKiB reserved=%zuKiB slots=%zuKiB"
+                  " chunks=%zu released=%zu fragmentation=%.1f%%",
+                  messages, live / 1024, used / 1024, reserved / 1024, slots / 1024,
+                  chunks, released, reserved > 0 ? 100.0 * (reserved - live) / reserved : 0.0);
+    report += line;
+    return report;
 }
 
-void NCurses::addMessage(const EventMessage& message)
+void NCurses::switchChannel(size_t index)
 {
-    std::lock_guard lock(backlogMutex);
-    backlog.push_front(BacklogMessage(message));
-    BacklogMessage& msg = backlog.front();
-    while (backlog.size() > 800) backlog.pop_back();
-    redraw = true;
-    if (scrollOffset > 0) scrollOffset += msg.getMessageLines(getmaxx(chatw)-11);
+    if (index == activeChannel) return;
+    activeChannel = index;
+    channels[activeChannel].unread = false;
+    searchResults.clear();
+    searchCursor = 0;
+    pendingSearch.reset();
+    matchPending = false;
+    appended = 0;
+    usersDirtyFrom = Roster::npos;
+    render.mark(DamageTabs | DamageChat | DamageUsers);
 }
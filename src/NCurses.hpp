@@ -1,40 +1,177 @@
 #pragma once
-#include "Queue.hpp"
 #include "JThread.hpp"
+#include <chrono>
+#include <functional>
+#include <optional>
 #include <vector>
 #include <string>
+#include "HackChatConnectionManager.hpp" // before ncurses.h, its timeout() macro breaks asio
 #include <ncurses.h>
+#include "Frontend.hpp"
 #include "HarpoonEventQueue.hpp"
-#include "HackChatEventQueue.hpp"
+#include "SimpleSignalHandler.hpp"
+#include "LatencyHistogram.hpp"
+#include "Backlog.hpp"
+#include "Roster.hpp"
+#include "TimeFormat.hpp"
+#include "RenderScheduler.hpp"
+#include "MentionMatcher.hpp"
+#include "History.hpp"
+#include "SearchIndex.hpp"
 
-class BacklogMessage;
-
-class NCurses
+class NCurses : public Frontend
 {
 public:
-    NCurses(EventQueue& queue, HackChatEventQueue& hackChatQueue);
-    ~NCurses();
+    struct Options
+    {
+        /// messages kept per channel, 0 for no limit
+        size_t scrollback;
+        /// bytes of backlog memory per channel, 0 for no limit
+        size_t scrollbackBytes;
+        TimeFormat timeFormat;
+        /// frames per second at most, 0 for no limit
+        unsigned maxFps;
+        /// own nick, messages naming it are highlighted
+        std::string nick;
+        /// further words that highlight a message
+        std::vector<std::string> highlights;
+        /// where the channel logs are kept, empty to keep no history
+        std::string historyDirectory;
+    };
+
+    NCurses(EventQueue& queue, hackchat::ConnectionManager& connections, SimpleSignalHandler& signalHandler,
+            const Options& options);
+    ~NCurses() override;
 
-    void onInput(const EventInput&);
-    void onUserList(const EventUserList&);
-    void onUserChanged(const EventUserChanged&);
-    void onMessage(const EventMessage&);
+    void join() override;
+    /// messages/s, frame-to-screen latency and backlog memory
+    std::string describeStats() const override;
+
+    void onInput(const EventInput&) override;
+    void onUserList(EventUserList&&) override;
+    void onUserChanged(const EventUserChanged&) override;
+    void onMessage(EventMessage&&) override;
 
 private:
-    void addMessage(const EventMessage& message);
+    /// messages read from the history at once
+    static constexpr size_t HistoryPage = 256;
+    /// messages indexed per loop iteration while catching up
+    static constexpr size_t IndexBudget = 256;
+
+    /// state of one connection, only the active one is shown
+    struct Channel
+    {
+        inline Channel(size_t scrollback, size_t scrollbackBytes, WorkerPool* workers, std::function<void()> onRewrapped)
+            : backlog(scrollback, scrollbackBytes, workers, std::move(onRewrapped))
+        {
+        }
+
+        std::string name;
+        Roster users;
+        Backlog backlog;
+        int scrollOffset = 0;
+        /// keeps the view in place while a resize rewraps the lines below it
+        std::optional<Backlog::Anchor> anchor;
+        bool unread = false;
+        /// nothing older left on disk
+        bool historyLoaded = false;
+        /// sequence of the message at the history's loaded position, every
+        /// message is logged so the evicted ones are the records to skip
+        uint64_t historyFrom = 0;
+        /// trails the backlog, catches up when idle, reaches into the
+        /// history on disk below the oldest message for a search
+        SearchIndex search;
+        /// log position of the oldest message indexed before being paged in
+        uint64_t indexedFrom = 0;
+        /// what the messages indexed ahead would take in the backlog
+        size_t indexedAheadBytes = 0;
+        /// indexed as far back as the scrollback can hold
+        bool historyIndexed = false;
+    };
+
+    /// parts of the screen to draw again
+    enum Damage : unsigned
+    {
+        DamageLayout = 1,
+        DamageTabs = 2,
+        DamageChat = 4,
+        DamageUsers = 8,
+        DamageInput = 16,
+        /// only messages added at the bottom of the chat
+        DamageAppend = 32,
+        /// only the user rows from usersDirtyFrom down
+        DamageUserRows = 64
+    };
+
+    /// draws a message whose first line is bottom lines above the end of the chat pane
+    void drawMessage(BacklogMessage& message, LineSpan lines, int bottom, int rows);
+    void addMessage(EventMessage&& message);
+    void addStatus(std::string text);
+    /// completes the nick before the cursor, again to cycle through the matches
+    void completeNick();
+    void switchChannel(size_t index);
+    /// records the latency of the messages just drawn
+    void recordShown();
+    /// pages in older history above the backlog, false if nothing more fits or is left
+    bool loadHistory(size_t channel);
+    /// moves the history past the messages evicted since, the search
+    /// forgets those indexed ahead
+    void forgetEvicted(size_t channel);
+    /// indexes up to budget messages for search, true while more are waiting
+    bool indexPending(size_t channel, size_t budget);
+    /// indexes up to budget messages on disk that could still be paged in,
+    /// true while more are waiting
+    bool indexHistory(size_t channel, size_t budget);
+    /// /search with a new query, or without one for the next older match
+    void search(std::string_view query);
+    /// one step of a search between frames, true while more are waiting
+    bool stepSearch();
+    /// scrolls to the match before searchCursor
+    void showMatch();
 
     EventQueue& queue;
-    HackChatEventQueue& hackChatQueue;
-    bool redraw;
-    bool redrawusers;
-    std::mutex usersMutex;
-    std::vector<std::string> users;
-    std::mutex backlogMutex;
-    std::list<BacklogMessage> backlog;
+    hackchat::ConnectionManager& connections;
+    SimpleSignalHandler& signalHandler;
+    const TimeFormat timeFormat;
+    /// column where message text starts, after the time and " | "
+    const int textColumn;
+    RenderScheduler render;
+    const std::string nick;
+    const MentionMatcher mentions;
+    /// messages written by a background thread, paged in when scrolling up
+    std::unique_ptr<History> history;
+    /// messages added at the bottom of the active channel since the last draw
+    size_t appended;
+    /// first sidebar row moved by a join or part since the last draw
+    size_t usersDirtyFrom;
+    /// sidebar rows holding a nick after the last draw
+    size_t usersDrawn;
+    /// rewraps off-screen backlog after a resize, outlives the channels
+    WorkerPool rewrapWorkers;
+    std::vector<Channel> channels;
+    size_t activeChannel;
     std::string buffer;
+    /// nicks matching the word being completed, empty when not completing
+    std::vector<std::string> completions;
+    size_t completionIndex;
+    /// where the completed word starts in the buffer
+    size_t completionStart;
+    /// matches of the last /search in the active channel, ascending
+    std::vector<uint64_t> searchResults;
+    /// the match shown is the one before this
+    size_t searchCursor;
+    /// waits for the index to catch up
+    std::optional<SearchQuery> pendingSearch;
+    /// the next match is shown once it is paged in
+    bool matchPending;
     int lastk = 0;
     NJThread t;
-    NJThread eventHandlerThread;
     WINDOW* chatw;
-    int scrollOffset;
+
+    /// server time of messages added to the active channel since the last draw
+    std::vector<int64_t> pendingShown;
+    LatencyHistogram latency;
+    uint64_t ingested;
+    std::chrono::steady_clock::time_point firstIngest;
+    std::chrono::steady_clock::time_point lastIngest;
 };
@@ -0,0 +1,127 @@
+#include "NickTrie.hpp"
+#include <algorithm>
+#include "AsciiFold.hpp"
+
+namespace
+{
+
+inline bool keyLess(const std::pair<char, uint32_t>& entry, char c)
+{
+    return static_cast<unsigned char>(entry.first) < static_cast<unsigned char>(c);
+}
+
+}
+
+NickTrie::NickTrie()
+    : nodes(1)
+    , freeNodes()
+{
+}
+
+void NickTrie::insert(std::string_view nick)
+{
+    uint32_t node = 0;
+    ++nodes[0].count;
+    for (char c : nick)
+    {
+        const char key = asciiLower(c);
+        uint32_t next = child(node, key);
+        if (next == 0)
+        {
+            next = allocate(node);
+            auto& children = nodes[node].children;
+            children.insert(std::lower_bound(children.begin(), children.end(), key, keyLess), {key, next});
+        }
+        node = next;
+        ++nodes[node].count;
+    }
+    nodes[node].nicks.push_back(nick);
+}
+
+void NickTrie::erase(std::string_view nick)
+{
+    uint32_t node = 0;
+    for (char c : nick)
+    {
+        node = child(node, asciiLower(c));
+        if (node == 0) return;
+    }
+    auto& nicks = nodes[node].nicks;
+    auto it = std::find(nicks.begin(), nicks.end(), nick);
+    if (it == nicks.end()) return;
+    nicks.erase(it);
+
+    // walk back up, nodes nobody passes through anymore are recycled
+    size_t depth = nick.size();
+    for (;;)
+    {
+        const uint32_t parent = nodes[node].parent;
+        if (--nodes[node].count == 0 && node != 0)
+        {
+            auto& siblings = nodes[parent].children;
+            siblings.erase(std::lower_bound(siblings.begin(), siblings.end(), asciiLower(nick[depth-1]), keyLess));
+            nodes[node].children.clear();
+            freeNodes.push_back(node);
+        }
+        if (node == 0) break;
+        node = parent;
+        --depth;
+    }
+}
+
+void NickTrie::clear()
+{
+    nodes.resize(1);
+    nodes[0] = Node{};
+    freeNodes.clear();
+}
+
+void NickTrie::complete(std::string_view prefix, std::vector<std::string_view>& matches, size_t limit) const
+{
+    uint32_t node = 0;
+    for (char c : prefix)
+    {
+        node = child(node, asciiLower(c));
+        if (node == 0) return;
+    }
+    collect(node, matches, limit);
+}
+
+uint32_t NickTrie::child(uint32_t node, char c) const
+{
+    const auto& children = nodes[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), c, keyLess);
+    return it != children.end() && it->first == c ? it->second : 0;
+}
+
+uint32_t NickTrie::allocate(uint32_t parent)
+{
+    uint32_t node;
+    if (!freeNodes.empty())
+    {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else
+    {
+        node = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[node].parent = parent;
+    nodes[node].count = 0;
+    return node;
+}
+
+void NickTrie::collect(uint32_t node, std::vector<std::string_view>& matches, size_t limit) const
+{
+    for (std::string_view nick : nodes[node].nicks)
+    {
+        if (matches.size() >= limit) return;
+        matches.push_back(nick);
+    }
+    for (const auto& entry : nodes[node].children)
+    {
+        if (matches.size() >= limit) return;
+        collect(entry.second, matches, limit);
+    }
+}
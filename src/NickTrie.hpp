@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+/// Case-insensitive prefix tree of nicks for completion. Holds views, the
+/// nicks must outlive their entry. Finding the node of a prefix takes
+/// O(prefix length), the matches below it come out in alphabetical order.
+class NickTrie
+{
+public:
+    NickTrie();
+
+    void insert(std::string_view nick);
+    void erase(std::string_view nick);
+    void clear();
+    /// appends up to limit nicks starting with prefix
+    void complete(std::string_view prefix, std::vector<std::string_view>& matches, size_t limit) const;
+
+private:
+    struct Node
+    {
+        /// sorted by lowered character
+        std::vector<std::pair<char, uint32_t>> children;
+        uint32_t parent;
+        /// nicks ending here or below
+        uint32_t count;
+        /// nicks ending here, they differ only in case
+        std::vector<std::string_view> nicks;
+    };
+
+    /// child for the character or 0
+    uint32_t child(uint32_t node, char c) const;
+    uint32_t allocate(uint32_t parent);
+    void collect(uint32_t node, std::vector<std::string_view>& matches, size_t limit) const;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+};
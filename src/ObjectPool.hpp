@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+
+/// Keeps released objects around so their buffers can be refilled instead
+/// of being freed and allocated again.
+template<class T>
+class ObjectPool
+{
+public:
+    inline explicit ObjectPool(size_t maxSize)
+        : maxSize(maxSize)
+    {
+    }
+
+    /// a recycled object with stale content or a new one
+    inline T acquire()
+    {
+        {
+            std::lock_guard lock(poolMutex);
+            if (!objects.empty())
+            {
+                T object(std::move(objects.back()));
+                objects.pop_back();
+                return object;
+            }
+        }
+        return T();
+    }
+
+    inline void release(T&& object)
+    {
+        std::lock_guard lock(poolMutex);
+        if (objects.size() < maxSize) objects.push_back(std::move(object));
+    }
+
+private:
+    std::mutex poolMutex;
+    std::vector<T> objects;
+    size_t maxSize;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+/// Collision free index of a fixed set of names, built at compile time.
+/// The hash only looks at the length and three characters, a seed is
+/// searched until no two names share a slot.
+template<size_t N, size_t Slots = 32>
+class PerfectHash
+{
+    static_assert(N < Slots && (Slots & (Slots - 1)) == 0, "Slots must be a power of two larger than N");
+
+public:
+    constexpr explicit PerfectHash(const std::array<std::string_view, N>& names)
+        : names(names)
+        , seed(0)
+        , slots()
+    {
+        for (uint32_t candidate = 1; candidate < 100000; ++candidate)
+        {
+            if (tryFill(candidate))
+            {
+                seed = candidate;
+                return;
+            }
+        }
+    }
+
+    /// true if a collision free seed was found
+    constexpr bool valid() const { return seed != 0; }
+
+    /// index of name or N if it is not in the set
+    constexpr size_t find(std::string_view name) const
+    {
+        const size_t index = slots[hash(name, seed)];
+        return index < N && names[index] == name ? index : N;
+    }
+
+private:
+    static constexpr size_t hash(std::string_view name, uint32_t seed)
+    {
+        if (name.empty()) return 0;
+        uint32_t h = seed * 2654435761u;
+        h = (h ^ static_cast<uint32_t>(name.size())) * 16777619u;
+        h = (h ^ static_cast<unsigned char>(name[0])) * 16777619u;
+        h = (h ^ static_cast<unsigned char>(name[name.size() / 2])) * 16777619u;
+        h = (h ^ static_cast<unsigned char>(name[name.size() - 1])) * 16777619u;
+        return (h >> 16) & (Slots - 1);
+    }
+
+    constexpr bool tryFill(uint32_t candidate)
+    {
+        for (size_t i = 0; i < Slots; ++i) slots[i] = N;
+        for (size_t i = 0; i < N; ++i)
+        {
+            const size_t slot = hash(names[i], candidate);
+            if (slots[slot] != N) return false;
+            slots[slot] = i;
+        }
+        return true;
+    }
+
+    std::array<std::string_view, N> names;
+    uint32_t seed;
+    std::array<size_t, Slots> slots;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+/// Collects dirty bits from any thread and hands them to the render loop
+/// at most maxFps times per second, so a burst of events becomes a single
+/// frame. The first change after an idle period is drawn right away.
+class RenderScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// 0 draws every change immediately
+    inline explicit RenderScheduler(unsigned maxFps)
+        : dirty(0)
+        , interval(maxFps > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / maxFps
+                              : Clock::duration::zero())
+        , nextFrame()
+        , eventCount(0)
+        , frameCount(0)
+    {
+    }
+
+    inline void mark(unsigned bits) { dirty.fetch_or(bits, std::memory_order_relaxed); }
+    inline void countEvents(uint64_t count) { eventCount += count; }
+
+    /// the bits to draw now and clears them, 0 if clean or too early
+    inline unsigned take(Clock::time_point now)
+    {
+        if (dirty.load(std::memory_order_relaxed) == 0 || now < nextFrame) return 0;
+        nextFrame = now + interval;
+        ++frameCount;
+        return dirty.exchange(0, std::memory_order_relaxed);
+    }
+
+    /// poll() timeout until the next frame is due, -1 if there is nothing to draw
+    inline int pollTimeout(Clock::time_point now) const
+    {
+        if (dirty.load(std::memory_order_relaxed) == 0) return -1;
+        if (now >= nextFrame) return 0;
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(nextFrame - now);
+        return static_cast<int>(wait.count());
+    }
+
+    inline uint64_t events() const { return eventCount; }
+    inline uint64_t frames() const { return frameCount; }
+
+private:
+    std::atomic<unsigned> dirty;
+    const Clock::duration interval;
+    Clock::time_point nextFrame;
+    uint64_t eventCount;
+    uint64_t frameCount;
+};
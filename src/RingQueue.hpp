@@ -0,0 +1,204 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+/// Bounded multi-producer/single-consumer queue.
+/// Producers claim cells with a CAS on the enqueue position, the consumer
+/// owns the dequeue position exclusively. The consumer only sleeps on the
+/// eventfd if the queue ran empty, so a busy queue never does a syscall.
+/// fd() can be polled together with other descriptors, see prepareWait().
+template<class T, size_t Capacity = 1024>
+class RingQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "RingQueue capacity must be a power of two");
+    static constexpr size_t CacheLineSize = 64;
+
+public:
+    inline RingQueue()
+        : cells(new Cell[Capacity])
+        , eventFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    {
+        if (eventFd < 0) throw std::runtime_error("Failed to create eventfd");
+        for (size_t i = 0; i < Capacity; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    inline ~RingQueue()
+    {
+        while (T* value = front())
+        {
+            value->~T();
+            release();
+        }
+        ::close(eventFd);
+    }
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    /// waits until a message arrives or interrupt() is called
+    inline std::optional<T> pop()
+    {
+        T* value = front();
+        if (!value)
+        {
+            waitFilled();
+            if (!(value = front())) return {};
+        }
+        std::optional<T> res(std::move(*value));
+        value->~T();
+        release();
+        return res;
+    }
+
+    /// pops everything available, waits like pop() if nothing is queued
+    inline size_t drain(std::vector<T>& batch)
+    {
+        if (!front()) waitFilled();
+        return tryDrain(batch);
+    }
+
+    /// pops what is available, at most Capacity so a batch cannot outgrow
+    /// the queue while producers keep refilling it
+    inline size_t tryDrain(std::vector<T>& batch)
+    {
+        size_t count = 0;
+        for (T* value; count < Capacity && (value = front());)
+        {
+            batch.push_back(std::move(*value));
+            value->~T();
+            release();
+            ++count;
+        }
+        return count;
+    }
+
+    /// consumer only: arms the wakeup before polling fd().
+    /// Returns false if messages are already queued and polling must be skipped.
+    inline bool prepareWait()
+    {
+        consumerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!front())
+            return true;
+        consumerWaiting.store(false, std::memory_order_relaxed);
+        return false;
+    }
+
+    /// consumer only: to be called after polling fd()
+    inline void finishWait()
+    {
+        consumerWaiting.store(false, std::memory_order_relaxed);
+        eventfd_t value;
+        eventfd_read(eventFd, &value);
+    }
+
+    /// wakes up a waiting consumer, e.g. for shutdown
+    inline void interrupt()
+    {
+        eventfd_write(eventFd, 1);
+    }
+
+    inline int fd() const
+    {
+        return eventFd;
+    }
+
+    /// blocks the producer while the queue is full, false if the queue was
+    /// closed meanwhile and the message dropped
+    inline bool push(T&& message)
+    {
+        while (!tryPush(message))
+        {
+            if (closed.load(std::memory_order_acquire)) return false;
+            std::this_thread::yield();
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumerWaiting.load(std::memory_order_relaxed)
+            && consumerWaiting.exchange(false, std::memory_order_relaxed))
+            interrupt();
+        return true;
+    }
+
+    /// the consumer is gone, producers drop what does not fit instead of
+    /// waiting for room that never comes
+    inline void close()
+    {
+        closed.store(true, std::memory_order_release);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    inline bool tryPush(T& message)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;)
+        {
+            cell = &cells[pos & (Capacity - 1)];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        new (&cell->storage) T(std::move(message));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// consumer only: the next value or nullptr if the queue is empty
+    inline T* front()
+    {
+        Cell& cell = cells[dequeuePos & (Capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) return nullptr;
+        return std::launder(reinterpret_cast<T*>(&cell.storage));
+    }
+
+    /// consumer only: hands the front cell back to the producers
+    inline void release()
+    {
+        cells[dequeuePos & (Capacity - 1)].sequence.store(dequeuePos + Capacity, std::memory_order_release);
+        ++dequeuePos;
+    }
+
+    inline void waitFilled()
+    {
+        if (!prepareWait()) return;
+        pollfd pfd{eventFd, POLLIN, 0};
+        poll(&pfd, 1, -1);
+        finishWait();
+    }
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(CacheLineSize) std::atomic<size_t> enqueuePos{0};
+    alignas(CacheLineSize) size_t dequeuePos = 0;
+    alignas(CacheLineSize) std::atomic<bool> consumerWaiting{false};
+    std::atomic<bool> closed{false};
+    int eventFd;
+};
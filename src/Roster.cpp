@@ -0,0 +1,73 @@
+#include "Roster.hpp"
+#include <algorithm>
+#include "AsciiFold.hpp"
+
+bool Roster::NickLess::operator()(std::string_view a, std::string_view b) const
+{
+    const size_t length = std::min(a.size(), b.size());
+    for (size_t i = 0; i < length; ++i)
+    {
+        const char la = asciiLower(a[i]), lb = asciiLower(b[i]);
+        if (la != lb) return static_cast<unsigned char>(la) < static_cast<unsigned char>(lb);
+    }
+    if (a.size() != b.size()) return a.size() < b.size();
+    // nicks differing only in case keep a fixed order
+    return a < b;
+}
+
+Roster::Roster(Roster&& other)
+    : nicks()
+    , order()
+    , trie()
+{
+    // node based, the views in the tree and trie stay valid
+    nicks.swap(other.nicks);
+    order.swap(other.order);
+    std::swap(trie, other.trie);
+}
+
+Roster& Roster::operator=(Roster&& other)
+{
+    nicks.swap(other.nicks);
+    order.swap(other.order);
+    std::swap(trie, other.trie);
+    return *this;
+}
+
+void Roster::assign(std::vector<std::string>&& list)
+{
+    order.clear();
+    trie.clear();
+    nicks.clear();
+    nicks.reserve(list.size());
+    for (auto& nick : list)
+    {
+        auto inserted = nicks.insert(std::move(nick));
+        if (!inserted.second) continue;
+        order.insert(*inserted.first);
+        trie.insert(*inserted.first);
+    }
+    list.clear();
+}
+
+size_t Roster::add(std::string nick)
+{
+    auto inserted = nicks.insert(std::move(nick));
+    if (!inserted.second) return npos;
+    const std::string_view view = *inserted.first;
+    order.insert(view);
+    trie.insert(view);
+    return order.order_of_key(view);
+}
+
+size_t Roster::remove(const std::string& nick)
+{
+    auto it = nicks.find(nick);
+    if (it == nicks.end()) return npos;
+    const std::string_view view = *it;
+    const size_t row = order.order_of_key(view);
+    order.erase(view);
+    trie.erase(view);
+    nicks.erase(it);
+    return row;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+#include "NickTrie.hpp"
+
+
+/// Users of a channel in display order, case-insensitive by nick. The
+/// nicks are owned by a hash set, an order statistic tree over views of
+/// them gives each nick its row, so joins and parts take O(log n) and
+/// report the first row that moved. A trie over the same views completes
+/// nicks.
+class Roster
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct NickLess
+    {
+        bool operator()(std::string_view a, std::string_view b) const;
+    };
+    using Tree = __gnu_pbds::tree<std::string_view, __gnu_pbds::null_type, NickLess,
+                                  __gnu_pbds::rb_tree_tag, __gnu_pbds::tree_order_statistics_node_update>;
+    using const_iterator = Tree::const_iterator;
+
+    Roster() = default;
+    Roster(Roster&& other);
+    Roster& operator=(Roster&& other);
+
+    /// replaces everyone, the nicks are moved in
+    void assign(std::vector<std::string>&& nicks);
+    /// the row of the new nick, npos if it was there already
+    size_t add(std::string nick);
+    /// the row the nick had, npos if it was missing
+    size_t remove(const std::string& nick);
+
+    inline bool contains(const std::string& nick) const { return nicks.count(nick) > 0; }
+    inline size_t size() const { return order.size(); }
+    inline const_iterator begin() const { return order.begin(); }
+    inline const_iterator end() const { return order.end(); }
+    /// the nick shown in this row, O(log n)
+    inline const_iterator nth(size_t row) const { return order.find_by_order(row); }
+    /// appends up to limit nicks starting with prefix, ignoring case
+    inline void complete(std::string_view prefix, std::vector<std::string_view>& matches, size_t limit) const
+    {
+        trie.complete(prefix, matches, limit);
+    }
+
+private:
+    std::unordered_set<std::string> nicks;
+    Tree order;
+    NickTrie trie;
+};
@@ -0,0 +1,296 @@
+#include "SearchIndex.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "AsciiFold.hpp"
+
+namespace
+{
+
+void lowerInPlace(std::string& text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](char c){ return asciiLower(c); });
+}
+
+std::string lowered(std::string_view text)
+{
+    std::string out(text);
+    lowerInPlace(out);
+    return out;
+}
+
+/// appends the words of text to out, views into lower, its lower case copy
+void splitWords(std::string_view text, std::string& lower, std::vector<std::string_view>& out)
+{
+    lower.assign(text.data(), text.size());
+    lowerInPlace(lower);
+    for (size_t i = 0; i < lower.size();)
+    {
+        if (!isWordChar(lower[i]))
+        {
+            ++i;
+            continue;
+        }
+        const size_t start = i;
+        while (i < lower.size() && isWordChar(lower[i])) ++i;
+        out.emplace_back(lower.data() + start, i - start);
+    }
+}
+
+/// days since 1970-01-01 in the proleptic gregorian calendar
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+/// reads count digits at pos
+bool digits(std::string_view text, size_t& pos, size_t count, unsigned& value)
+{
+    if (pos + count > text.size()) return false;
+    value = 0;
+    for (size_t end = pos + count; pos < end; ++pos)
+    {
+        if (text[pos] < '0' || text[pos] > '9') return false;
+        value = value * 10 + static_cast<unsigned>(text[pos] - '0');
+    }
+    return true;
+}
+
+/// ms since the epoch of YYYY-MM-DD[THH:MM] in UTC or of n[mhdw] before now
+int64_t parseTime(std::string_view text, int64_t now)
+{
+    const size_t unitPos = text.find_first_not_of("0123456789");
+    if (unitPos > 0 && unitPos != std::string_view::npos && unitPos + 1 == text.size())
+    {
+        int64_t unit;
+        switch (text[unitPos])
+        {
+            case 'm': unit = 60 * 1000; break;
+            case 'h': unit = 60 * 60 * 1000; break;
+            case 'd': unit = 24 * 60 * 60 * 1000; break;
+            case 'w': unit = 7 * 24 * 60 * 60 * 1000; break;
+            default: throw std::invalid_argument("unknown time unit in " + std::string(text));
+        }
+        size_t pos = 0;
+        unsigned count;
+        if (unitPos > 6 || !digits(text, pos, unitPos, count))
+            throw std::invalid_argument("time out of range: " + std::string(text));
+        return now - count * unit;
+    }
+
+    size_t pos = 0;
+    unsigned year, month, day, hour = 0, minute = 0;
+    bool valid = digits(text, pos, 4, year) && pos < text.size() && text[pos++] == '-'
+                 && digits(text, pos, 2, month) && pos < text.size() && text[pos++] == '-'
+                 && digits(text, pos, 2, day);
+    if (valid && pos < text.size())
+    {
+        valid = text[pos++] == 'T' && digits(text, pos, 2, hour) && pos < text.size() && text[pos++] == ':'
+                && digits(text, pos, 2, minute) && pos == text.size();
+    }
+    if (!valid || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59)
+        throw std::invalid_argument("expected YYYY-MM-DD[THH:MM] or a number of m, h, d or w: " + std::string(text));
+    return ((daysFromCivil(year, month, day) * 24 + hour) * 60 + minute) * 60 * 1000;
+}
+
+/// keeps the ids of result also found in postings, both ascending
+void intersect(std::vector<uint64_t>& result, const std::vector<uint64_t>& postings)
+{
+    auto from = postings.begin();
+    auto kept = result.begin();
+    for (uint64_t id : result)
+    {
+        from = std::lower_bound(from, postings.end(), id);
+        if (from == postings.end()) break;
+        if (*from == id) *kept++ = id;
+    }
+    result.erase(kept, result.end());
+}
+
+}
+
+
+SearchQuery SearchQuery::parse(std::string_view text, int64_t now)
+{
+    SearchQuery query;
+    for (size_t start = 0; start < text.size();)
+    {
+        size_t end = text.find(' ', start);
+        if (end == std::string_view::npos) end = text.size();
+        const std::string_view part = text.substr(start, end - start);
+        start = end + 1;
+        if (part.empty()) continue;
+
+        if (part.substr(0, 5) == "from:")
+        {
+            std::string_view nick = part.substr(5);
+            if (!nick.empty() && nick[0] == '@') nick.remove_prefix(1);
+            if (nick.empty()) throw std::invalid_argument("from: needs a nick");
+            query.from = lowered(nick);
+        }
+        else if (part.substr(0, 6) == "since:")
+        {
+            query.since = parseTime(part.substr(6), now);
+        }
+        else if (part.substr(0, 6) == "until:")
+        {
+            query.until = parseTime(part.substr(6), now);
+        }
+        else
+        {
+            std::string lower;
+            std::vector<std::string_view> words;
+            splitWords(part, lower, words);
+            query.words.insert(query.words.end(), words.begin(), words.end());
+        }
+    }
+    std::sort(query.words.begin(), query.words.end());
+    query.words.erase(std::unique(query.words.begin(), query.words.end()), query.words.end());
+    if (query.words.empty() && query.from.empty())
+        throw std::invalid_argument("nothing to search for");
+    return query;
+}
+
+
+SearchIndex::SearchIndex()
+    : words()
+    , senders()
+    , times()
+    , first(0)
+    , last(0)
+    , swept(0)
+    , lowerText()
+    , scratch()
+    , key()
+{
+}
+
+void SearchIndex::reset(uint64_t id)
+{
+    words.clear();
+    senders.clear();
+    times.clear();
+    first = last = swept = id;
+}
+
+void SearchIndex::add(const BacklogMessage& message)
+{
+    const uint64_t id = last++;
+    times.push_back(message.getTime());
+    // only what people wrote, not joins or the client's own notes
+    if (message.getFlags().status) return;
+    postings(senders, message.getSender()).push_back(id);
+    collectWords(message);
+    for (std::string_view word : scratch)
+        postings(words, word).push_back(id);
+}
+
+void SearchIndex::addOlder(const std::vector<const BacklogMessage*>& messages)
+{
+    if (swept < first) sweep(); // dropped ids would end up among the new ones
+    // the ids of each word are gathered first, every list grows at its front once
+    Map newWords, newSenders;
+    uint64_t id = first - messages.size();
+    first = swept = id;
+    for (auto it = messages.rbegin(); it != messages.rend(); ++it)
+        times.push_front((*it)->getTime());
+    for (const BacklogMessage* message : messages)
+    {
+        if (!message->getFlags().status)
+        {
+            postings(newSenders, message->getSender()).push_back(id);
+            collectWords(*message);
+            for (std::string_view word : scratch)
+                postings(newWords, word).push_back(id);
+        }
+        ++id;
+    }
+    for (auto [from, into] : {std::make_pair(&newWords, &words), std::make_pair(&newSenders, &senders)})
+    {
+        for (auto& [word, ids] : *from)
+        {
+            Postings& list = (*into)[word];
+            list.insert(list.begin(), ids.begin(), ids.end());
+        }
+    }
+}
+
+void SearchIndex::dropBefore(uint64_t id)
+{
+    if (id <= first) return;
+    if (id >= last)
+    {
+        reset(id);
+        return;
+    }
+    times.erase(times.begin(), times.begin() + (id - first));
+    first = id;
+    // find() skips the dropped ids, sweeping them out once there are as many as live ones costs little per id
+    if (first - swept >= last - first) sweep();
+}
+
+std::vector<uint64_t> SearchIndex::find(const SearchQuery& query) const
+{
+    std::vector<const Postings*> lists;
+    if (!query.from.empty())
+    {
+        auto it = senders.find(query.from);
+        if (it == senders.end()) return {};
+        lists.push_back(&it->second);
+    }
+    for (const std::string& word : query.words)
+    {
+        auto it = words.find(word);
+        if (it == words.end()) return {};
+        lists.push_back(&it->second);
+    }
+    if (lists.empty()) return {};
+    std::sort(lists.begin(), lists.end(), [](const Postings* a, const Postings* b){ return a->size() < b->size(); });
+
+    std::vector<uint64_t> result;
+    result.reserve(lists[0]->size());
+    for (auto it = std::lower_bound(lists[0]->begin(), lists[0]->end(), first); it != lists[0]->end(); ++it)
+    {
+        const int64_t time = times[*it - first];
+        if (time >= query.since && time < query.until) result.push_back(*it);
+    }
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i)
+        intersect(result, *lists[i]);
+    return result;
+}
+
+void SearchIndex::collectWords(const BacklogMessage& message)
+{
+    scratch.clear();
+    splitWords(message.getText(), lowerText, scratch);
+    std::sort(scratch.begin(), scratch.end());
+    scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+}
+
+SearchIndex::Postings& SearchIndex::postings(Map& map, std::string_view text)
+{
+    key.assign(text.data(), text.size());
+    lowerInPlace(key);
+    auto it = map.find(key);
+    if (it == map.end()) it = map.emplace(key, Postings()).first;
+    return it->second;
+}
+
+void SearchIndex::sweep()
+{
+    for (Map* map : {&words, &senders})
+    {
+        for (auto it = map->begin(); it != map->end();)
+        {
+            Postings& ids = it->second;
+            ids.erase(ids.begin(), std::lower_bound(ids.begin(), ids.end(), first));
+            if (ids.empty()) it = map->erase(it);
+            else ++it;
+        }
+    }
+    swept = first;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "BacklogMessage.hpp"
+
+
+/// What /search looks for: all words, optionally from one sender and
+/// within [since, until) in ms since the epoch
+struct SearchQuery
+{
+    std::vector<std::string> words;
+    /// lower case nick, empty for anyone
+    std::string from;
+    int64_t since = std::numeric_limits<int64_t>::min();
+    int64_t until = std::numeric_limits<int64_t>::max();
+
+    /// "words from:nick since:2024-05-01 until:2h", times are UTC dates as
+    /// YYYY-MM-DD[THH:MM] or a number of m, h, d or w before now.
+    /// Throws std::invalid_argument on a bad filter or without any word or sender.
+    static SearchQuery parse(std::string_view text, int64_t now);
+};
+
+/// Inverted index over the messages of one channel. Every word maps to the
+/// ascending ids of the messages holding it, a query intersects the lists
+/// starting with the shortest one. Ids are consecutive, newer messages are
+/// added at the end and older ones in front of the first. Dropped ids stay
+/// in the lists until there are as many of them as live ones, or until
+/// older messages are added.
+class SearchIndex
+{
+public:
+    SearchIndex();
+
+    inline bool empty() const { return first == last; }
+    /// the oldest id indexed
+    inline uint64_t begin() const { return first; }
+    /// the id the next newer message has to have
+    inline uint64_t end() const { return last; }
+
+    /// drops everything, the next message added gets id
+    void reset(uint64_t id);
+    /// indexes the message with id end()
+    void add(const BacklogMessage& message);
+    /// indexes messages ending right before begin(), oldest first
+    void addOlder(const std::vector<const BacklogMessage*>& messages);
+    /// forgets all messages before id
+    void dropBefore(uint64_t id);
+
+    /// ids of the matching messages, ascending
+    std::vector<uint64_t> find(const SearchQuery& query) const;
+
+private:
+    using Postings = std::vector<uint64_t>;
+    using Map = std::unordered_map<std::string, Postings>;
+
+    /// lower case words of the message, each once, views into lowerText
+    void collectWords(const BacklogMessage& message);
+    /// the list of the lower case key, looked up without allocating unless it is new
+    Postings& postings(Map& map, std::string_view key);
+    /// removes the dropped ids from all lists
+    void sweep();
+
+    Map words;
+    Map senders;
+    /// time of every message from first to last
+    std::deque<int64_t> times;
+    uint64_t first;
+    uint64_t last;
+    /// no list holds an id below it
+    uint64_t swept;
+    std::string lowerText;
+    std::vector<std::string_view> scratch;
+    std::string key;
+};
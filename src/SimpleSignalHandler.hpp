@@ -2,6 +2,9 @@
 #pragma once
 #include <pthread.h>
 #include <signal.h>
+#include <stdexcept>
+#include <sys/signalfd.h>
+#include <unistd.h>
 #include "globals.hpp"
 
 class SimpleSignalHandler
@@ -13,21 +16,35 @@ public:
         sigemptyset(&sigset);
         sigaddset(&sigset, SIGTERM);
         sigaddset(&sigset, SIGINT);
+        sigaddset(&sigset, SIGWINCH);
         if (sigprocmask(SIG_BLOCK, &sigset, NULL)) throw std::runtime_error("Failed to set signal handler");
+        signalFd = signalfd(-1, &sigset, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (signalFd < 0) throw std::runtime_error("Failed to create signalfd");
     }
-    inline void handle()
+    inline ~SimpleSignalHandler()
     {
-        timespec ts;
-        ts.tv_sec = 1;
-        ts.tv_nsec = 0;
-        while (RUNNING)
-        {
-            int sig = sigtimedwait(&sigset, 0, &ts);
-            if (sig == SIGTERM || sig == SIGINT) break;
-        }
-        RUNNING = false;
+        close(signalFd);
+    }
+    SimpleSignalHandler(const SimpleSignalHandler&) = delete;
+    SimpleSignalHandler& operator=(const SimpleSignalHandler&) = delete;
+
+    /// to be polled for POLLIN
+    inline int fd() const
+    {
+        return signalFd;
+    }
+
+    /// returns the next pending signal or 0, stops RUNNING on SIGTERM/SIGINT
+    inline int next()
+    {
+        signalfd_siginfo info;
+        if (read(signalFd, &info, sizeof(info)) != sizeof(info)) return 0;
+        const int sig = static_cast<int>(info.ssi_signo);
+        if (sig == SIGTERM || sig == SIGINT) RUNNING = false;
+        return sig;
     }
 
 private:
     sigset_t sigset;
+    int signalFd;
 };
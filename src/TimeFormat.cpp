@@ -0,0 +1,97 @@
+#include "TimeFormat.hpp"
+#include <stdexcept>
+
+namespace
+{
+
+inline char* twoDigits(char* out, unsigned value)
+{
+    out[0] = static_cast<char>('0' + value / 10 % 10);
+    out[1] = static_cast<char>('0' + value % 10);
+    return out + 2;
+}
+
+/// year, month and day of days since 1970-01-01 in the proleptic gregorian calendar
+void civilFromDays(int64_t days, int64_t& year, unsigned& month, unsigned& day)
+{
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const unsigned yearOfEra = (dayOfEra - dayOfEra/1460 + dayOfEra/36524 - dayOfEra/146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365*yearOfEra + yearOfEra/4 - yearOfEra/100);
+    const unsigned monthIndex = (5*dayOfYear + 2) / 153;
+    day = dayOfYear - (153*monthIndex + 2)/5 + 1;
+    month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    year = static_cast<int64_t>(yearOfEra) + era * 400 + (month <= 2);
+}
+
+}
+
+TimeFormat::TimeFormat(const std::string& format)
+    : tokens()
+    , length(0)
+{
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        if (format[i] != '%')
+        {
+            tokens.push_back({Field::Literal, format[i]});
+            length += 1;
+            continue;
+        }
+        if (++i == format.size()) throw std::invalid_argument("Time format ends with %");
+        switch (format[i])
+        {
+        case 'H': tokens.push_back({Field::Hour, 0}); length += 2; break;
+        case 'M': tokens.push_back({Field::Minute, 0}); length += 2; break;
+        case 'S': tokens.push_back({Field::Second, 0}); length += 2; break;
+        case 'd': tokens.push_back({Field::Day, 0}); length += 2; break;
+        case 'm': tokens.push_back({Field::Month, 0}); length += 2; break;
+        case 'y': tokens.push_back({Field::Year2, 0}); length += 2; break;
+        case 'Y': tokens.push_back({Field::Year4, 0}); length += 4; break;
+        case '%': tokens.push_back({Field::Literal, '%'}); length += 1; break;
+        default: throw std::invalid_argument(std::string("Unsupported time format field %") + format[i]);
+        }
+    }
+    if (length > MaxLength) throw std::invalid_argument("Time format is too long");
+}
+
+void TimeFormat::format(int64_t timeMs, char* out) const
+{
+    int64_t seconds = timeMs / 1000;
+    if (timeMs % 1000 < 0) --seconds;
+    int64_t days = seconds / 86400;
+    int64_t secondOfDay = seconds % 86400;
+    if (secondOfDay < 0)
+    {
+        secondOfDay += 86400;
+        --days;
+    }
+    // the date is only needed by some formats
+    int64_t year = 0;
+    unsigned month = 0, day = 0;
+    bool dateKnown = false;
+
+    for (const Token& token : tokens)
+    {
+        switch (token.field)
+        {
+        case Field::Literal: *out++ = token.literal; break;
+        case Field::Hour: out = twoDigits(out, static_cast<unsigned>(secondOfDay / 3600)); break;
+        case Field::Minute: out = twoDigits(out, static_cast<unsigned>(secondOfDay / 60 % 60)); break;
+        case Field::Second: out = twoDigits(out, static_cast<unsigned>(secondOfDay % 60)); break;
+        default:
+            if (!dateKnown)
+            {
+                civilFromDays(days, year, month, day);
+                dateKnown = true;
+            }
+            const unsigned shownYear = static_cast<unsigned>(year < 0 ? 0 : year % 10000);
+            if (token.field == Field::Day) out = twoDigits(out, day);
+            else if (token.field == Field::Month) out = twoDigits(out, month);
+            else if (token.field == Field::Year2) out = twoDigits(out, shownYear % 100);
+            else out = twoDigits(twoDigits(out, shownYear / 100), shownYear % 100);
+            break;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/// strftime-like timestamp format, parsed once at startup. Supports %H %M
+/// %S %d %m %y %Y and %%, every field has a fixed width so all timestamps
+/// take width() columns. Times are shown in UTC.
+class TimeFormat
+{
+public:
+    static constexpr size_t MaxLength = 32;
+
+    /// throws std::invalid_argument for unknown fields or too long output
+    explicit TimeFormat(const std::string& format = "%H:%M:%S");
+
+    inline size_t width() const { return length; }
+    /// writes width() characters for the unix time in milliseconds
+    void format(int64_t timeMs, char* out) const;
+
+private:
+    enum class Field : uint8_t
+    {
+        Literal,
+        Hour,
+        Minute,
+        Second,
+        Day,
+        Month,
+        Year2,
+        Year4
+    };
+    struct Token
+    {
+        Field field;
+        char literal;
+    };
+
+    std::vector<Token> tokens;
+    size_t length;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+
+/// Classic token bucket. Tokens may go negative when a cost is forced,
+/// which delays whatever comes next.
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    inline TokenBucket(double capacity, double refillPerSecond)
+        : capacity(capacity)
+        , refillPerSecond(refillPerSecond)
+        , tokens(capacity)
+        , updated(Clock::now())
+    {
+    }
+
+    inline bool tryTake(double cost, Clock::time_point now)
+    {
+        refill(now);
+        if (tokens < cost) return false;
+        tokens -= cost;
+        return true;
+    }
+
+    inline void force(double cost, Clock::time_point now)
+    {
+        refill(now);
+        tokens -= cost;
+    }
+
+    /// time until cost can be taken
+    inline Clock::duration wait(double cost, Clock::time_point now)
+    {
+        refill(now);
+        if (tokens >= cost) return Clock::duration::zero();
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((cost - tokens) / refillPerSecond));
+    }
+
+private:
+    inline void refill(Clock::time_point now)
+    {
+        if (now <= updated) return;
+        tokens = std::min(capacity, tokens + std::chrono::duration<double>(now - updated).count() * refillPerSecond);
+        updated = now;
+    }
+
+    double capacity;
+    double refillPerSecond;
+    double tokens;
+    Clock::time_point updated;
+};
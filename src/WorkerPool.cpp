@@ -0,0 +1,49 @@
+#include "WorkerPool.hpp"
+
+WorkerPool::WorkerPool(const std::string& name, size_t threadCount)
+    : mutex()
+    , jobsAvailable()
+    , jobs()
+    , stopping(false)
+    , threads()
+{
+    threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+        threads.emplace_back(name, [this]{ run(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobsAvailable.notify_all();
+    for (auto& thread : threads) thread.join();
+}
+
+void WorkerPool::post(std::function<void()> job)
+{
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobsAvailable.notify_one();
+}
+
+void WorkerPool::run()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex);
+            jobsAvailable.wait(lock, [this]{ return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "JThread.hpp"
+
+
+/// A few threads for background work of the frontend, jobs run in the
+/// order they were posted. Pending jobs are dropped on destruction.
+class WorkerPool
+{
+public:
+    WorkerPool(const std::string& name, size_t threadCount);
+    ~WorkerPool();
+
+    void post(std::function<void()> job);
+
+private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable jobsAvailable;
+    std::deque<std::function<void()>> jobs;
+    bool stopping;
+    std::vector<NJThread> threads;
+};
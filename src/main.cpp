@@ -3,12 +3,13 @@
 #include <boost/program_options.hpp>
 #include <variant>
 #include <map>
+#include <memory>
 #include <sstream>
-#include "Queue.hpp"
 #include "JThread.hpp"
 #include "SimpleSignalHandler.hpp"
-#include "HackChatClient.hpp"
+#include "HackChatConnectionManager.hpp"
 #include "NCurses.hpp"
+#include "HeadlessFrontend.hpp"
 #include "HackChatEvents.hpp"
 
 namespace po = boost::program_options;
@@ -17,7 +18,12 @@ bool RUNNING = true;
 
 int main(int argc, char* argv[])
 {
-    std::string username, password, channel;
+    std::string username, password, server, capturePath, replayPath, replaySpeed;
+    std::string outputPath, format, timeFormat;
+    bool latencyReport, headless;
+    std::vector<std::string> channels;
+    size_t threads;
+    NCurses::Options ncursesOptions;
     {
         po::options_description desc("Options");
         po::variables_map vm;
@@ -26,9 +32,34 @@ int main(int argc, char* argv[])
         {
             desc.add_options()
                     ("help", "Show this help")
-                    ("username", po::value<std::string>()->required(), "The username")
+                    ("username", po::value<std::string>(), "The username, required unless replaying")
                     ("password", po::value<std::string>(), "The password")
-                    ("channel", po::value<std::string>()->default_value("programming"), "The channel name without #");
+                    ("channel", po::value<std::vector<std::string>>()->multitoken()
+                                    ->default_value(std::vector<std::string>{"programming"}, "programming"),
+                     "The channel names without ?, one connection each")
+                    ("threads", po::value<size_t>()->default_value(2), "Threads shared by all connections")
+                    ("server", po::value<std::string>(&server)->default_value("wss://hack.chat/chat-ws"), "The websocket url")
+                    ("latency-report", po::bool_switch(&latencyReport),
+                     "Print message rate and frame-to-screen latency on exit")
+                    ("capture", po::value<std::string>(&capturePath), "Record inbound frames into this file")
+                    ("replay", po::value<std::string>(&replayPath), "Replay a capture instead of connecting")
+                    ("replay-speed", po::value<std::string>(&replaySpeed)->default_value("realtime"),
+                     "realtime or max")
+                    ("scrollback", po::value<size_t>(&ncursesOptions.scrollback)->default_value(0),
+                     "Messages kept per channel, 0 for no limit")
+                    ("scrollback-bytes", po::value<size_t>(&ncursesOptions.scrollbackBytes)->default_value(32 << 20),
+                     "Backlog memory per channel in bytes, 0 for no limit")
+                    ("time-format", po::value<std::string>(&timeFormat)->default_value("%H:%M:%S"),
+                     "Timestamp format in UTC, fields %H %M %S %d %m %y %Y")
+                    ("max-fps", po::value<unsigned>(&ncursesOptions.maxFps)->default_value(60),
+                     "Frames drawn per second at most, 0 for no limit")
+                    ("highlight", po::value<std::vector<std::string>>(&ncursesOptions.highlights)->multitoken(),
+                     "Words besides the own nick that highlight a message")
+                    ("history", po::value<std::string>(&ncursesOptions.historyDirectory),
+                     "Keep the history of every channel in this directory")
+                    ("headless", po::bool_switch(&headless), "Stream events instead of showing the terminal ui")
+                    ("output", po::value<std::string>(&outputPath)->default_value("-"), "Headless output file, - for stdout")
+                    ("format", po::value<std::string>(&format)->default_value("ndjson"), "Headless output format, ndjson or binary");
 
             po::store(po::parse_command_line(argc, argv, desc), vm);
 
@@ -39,10 +70,25 @@ int main(int argc, char* argv[])
             }
 
             po::notify(vm);
+            if (!vm.count("username") && replayPath.empty()) throw po::required_option("username");
+            if (replaySpeed != "realtime" && replaySpeed != "max")
+                throw po::invalid_option_value(replaySpeed);
+            if (format != "ndjson" && format != "binary")
+                throw po::invalid_option_value(format);
+            try
+            {
+                ncursesOptions.timeFormat = TimeFormat(timeFormat);
+            }
+            catch(const std::invalid_argument&)
+            {
+                throw po::invalid_option_value(timeFormat);
+            }
 
-            username = vm["username"].as<std::string>();
+            username = vm.count("username") ? vm["username"].as<std::string>() : std::string();
+            ncursesOptions.nick = username;
             password = vm.count("password") ? vm["password"].as<std::string>() : std::string();
-            channel = vm["channel"].as<std::string>();
+            channels = vm["channel"].as<std::vector<std::string>>();
+            threads = vm["threads"].as<size_t>();
         }
         catch(po::error& e)
         {
@@ -55,12 +101,46 @@ int main(int argc, char* argv[])
     SimpleSignalHandler simpleSignalHandler;
 
     EventQueue ncursesQueue;
-    hackchat::Client hackChatClient(ncursesQueue);
-
-    NCurses ncurses(ncursesQueue, hackChatClient.queue);
-
-    hackChatClient.queue.push(std::make_shared<EventHackConnect>("wss://hack.chat/chat-ws", channel, username, password));
+    hackchat::ConnectionManager connections(ncursesQueue, threads);
+    try
+    {
+        if (!capturePath.empty()) connections.startCapture(capturePath);
+        if (!replayPath.empty())
+        {
+            connections.replay(replayPath, replaySpeed == "realtime");
+        }
+        else
+        {
+            for (const auto& channel : channels)
+                connections.connect(server, channel, username, password);
+        }
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-    simpleSignalHandler.handle();
+    std::string report;
+    {
+        std::unique_ptr<Frontend> frontend;
+        try
+        {
+            if (headless)
+                frontend = std::make_unique<HeadlessFrontend>(
+                    ncursesQueue, connections, simpleSignalHandler, outputPath,
+                    format == "binary" ? HeadlessFrontend::Format::Binary : HeadlessFrontend::Format::NdJson);
+            else
+                frontend = std::make_unique<NCurses>(ncursesQueue, connections, simpleSignalHandler, ncursesOptions);
+        }
+        catch(const std::runtime_error& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        frontend->join();
+        report = frontend->describeStats();
+    }
+    if (latencyReport) std::cerr << report << std::endl;
     return 0;
 }